@@ -0,0 +1,114 @@
+#include "AllocationSites.h"
+#include "AstReader.h"
+#include "CfgLoops.h"
+#include <set>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/ExprCXX.h>
+#pragma warning (pop)
+
+using namespace clang;
+
+namespace
+{
+
+Stmt const *getStmt(GenericAstNode const *node)
+{
+    auto stmt = boost::get<Stmt *>(&node->myAstNode);
+    return stmt != nullptr ? *stmt : nullptr;
+}
+
+// Return false if the statement does not allocate
+bool describeAllocation(Stmt const *stmt, ASTContext &context, std::string &kind, std::string &allocated)
+{
+    if (auto newExpr = dyn_cast<CXXNewExpr>(stmt))
+    {
+        kind = newExpr->isArray() ? "new[]" : "new";
+        allocated = newExpr->getAllocatedType().getAsString();
+        return true;
+    }
+    if (auto call = dyn_cast<CallExpr>(stmt))
+    {
+        static std::set<std::string> const smartPointerFactories{ "make_shared", "make_unique", "allocate_shared" };
+        static std::set<std::string> const rawAllocators{ "malloc", "calloc", "realloc", "aligned_alloc", "strdup" };
+        auto callee = call->getDirectCallee();
+        if (callee == nullptr || callee->getIdentifier() == nullptr || isa<CXXMethodDecl>(callee))
+        {
+            return false;
+        }
+        auto name = callee->getName().str();
+        if (callee->isInStdNamespace() && smartPointerFactories.count(name) != 0)
+        {
+            kind = name;
+            auto arguments = callee->getTemplateSpecializationArgs();
+            allocated = arguments != nullptr && arguments->size() > 0 && arguments->get(0).getKind() == TemplateArgument::Type ?
+                arguments->get(0).getAsType().getAsString() :
+                call->getType().getAsString();
+            return true;
+        }
+        if ((callee->isExternC() || callee->isInStdNamespace()) && rawAllocators.count(name) != 0)
+        {
+            kind = name;
+            allocated = "Raw memory";
+            return true;
+        }
+        return false;
+    }
+    if (auto construct = dyn_cast<CXXConstructExpr>(stmt))
+    {
+        auto record = construct->getType()->getAsCXXRecordDecl();
+        if (record == nullptr || !record->isInStdNamespace() || record->getName() != "function" || construct->getNumArgs() == 0)
+        {
+            return false;
+        }
+        // Lambdas without captures fit in the small buffer of all implementations
+        auto argumentType = construct->getArg(0)->IgnoreImplicit()->getType();
+        auto lambda = argumentType->getAsCXXRecordDecl();
+        if (lambda == nullptr || !lambda->isLambda() || lambda->field_empty())
+        {
+            return false;
+        }
+        kind = "std::function";
+        allocated = "Capturing lambda of " + std::to_string(context.getTypeSizeInChars(argumentType).getQuantity()) + " bytes";
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+
+std::vector<AllocationSite> findAllocationSites(GenericAstNode *root, ASTContext &context)
+{
+    auto &manager = context.getSourceManager();
+    LoopDepthFinder depthFinder(context);
+    std::vector<AllocationSite> result;
+    std::vector<GenericAstNode *> toVisit{ root };
+    while (!toVisit.empty())
+    {
+        auto node = toVisit.back();
+        toVisit.pop_back();
+        for (auto &child : node->myChidren)
+        {
+            toVisit.push_back(child.get());
+        }
+        auto stmt = getStmt(node);
+        std::string kind;
+        std::string allocated;
+        if (stmt == nullptr || !describeAllocation(stmt, context, kind, allocated))
+        {
+            continue;
+        }
+        auto location = manager.getExpansionLoc(stmt->getLocStart());
+        if (!manager.isInMainFile(location))
+        {
+            continue;
+        }
+        std::string function;
+        auto depth = depthFinder.getLoopDepth(node, function);
+        result.push_back(AllocationSite{ node, kind, allocated, function, depth,
+            std::to_string(manager.getExpansionLineNumber(location)) + ":" + std::to_string(manager.getExpansionColumnNumber(location)) });
+    }
+    return result;
+}
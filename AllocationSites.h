@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/ASTContext.h>
+#pragma warning (pop)
+
+class GenericAstNode;
+
+// An expression that allocates on the heap, or may do so (std::function only allocates when the lambda does not
+// fit in its small buffer)
+struct AllocationSite
+{
+    GenericAstNode *node;
+    std::string kind; // new, make_shared, malloc...
+    std::string allocated; // Type, or callee for functions that allocate raw memory
+    std::string function; // The enclosing function
+    unsigned loopDepth; // From the control flow graph of the enclosing function, see CfgLoops.h
+    std::string position; // line:column
+};
+
+// Only the sites located in the main file are reported. The tree must be attached to a live AST.
+// In templates, that have no control flow graph, the loop depth is the number of enclosing loop statements.
+std::vector<AllocationSite> findAllocationSites(GenericAstNode *root, clang::ASTContext &context);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class GenericAstNode;
+
+// Result of an analysis, displayed as a table. Each row can be linked to the node it is about,
+// so that the user can navigate from the report to the tree.
+struct AnalysisReport
+{
+    struct Row
+    {
+        GenericAstNode *node; // Can be nullptr
+        std::vector<std::string> cells;
+        std::vector<Row> children; // For reports grouped by some key, displayed as a subtree
+    };
+    std::string title;
+    std::vector<std::string> headers;
+    std::vector<Row> rows;
+};
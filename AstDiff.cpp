@@ -0,0 +1,278 @@
+#include "AstDiff.h"
+#include <unordered_map>
+#include <algorithm>
+
+namespace
+{
+
+uint64_t const fnvOffsetBasis = 14695981039346656037ULL;
+uint64_t const fnvPrime = 1099511628211ULL;
+size_t const pairingWindow = 64; // How far we look ahead to pair two modified nodes with the same name
+
+uint64_t hashString(uint64_t hash, std::string const &s)
+{
+    for (unsigned char c : s)
+    {
+        hash ^= c;
+        hash *= fnvPrime;
+    }
+    // Terminator, so that ("ab", "c") and ("a", "bc") are not hashed the same way
+    hash ^= 0xFF;
+    hash *= fnvPrime;
+    return hash;
+}
+
+uint64_t hashValue(uint64_t hash, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        hash ^= (value >> (8 * i)) & 0xFF;
+        hash *= fnvPrime;
+    }
+    return hash;
+}
+
+uint64_t computeOwnHash(GenericAstNode *node)
+{
+    auto hash = hashString(fnvOffsetBasis, node->name);
+    for (auto &prop : node->getProperties())
+    {
+        hash = hashString(hash, prop.first);
+        hash = hashString(hash, prop.second);
+    }
+    return hash;
+}
+
+// Collapsed instantiations are hashed by their contents, built for the occasion and then dropped
+uint64_t hashCollapsedChildren(GenericAstNode *node)
+{
+    GenericAstNode temporaryRoot;
+    for (auto &child : node->childrenComputer())
+    {
+        temporaryRoot.attach(std::move(child));
+    }
+    computeStructuralHashes(&temporaryRoot);
+    return temporaryRoot.myStructuralHash;
+}
+
+using Children = std::vector<std::unique_ptr<GenericAstNode>>;
+
+// Shared type nodes are compared through the node they share, whether they have been expanded or not.
+// Collapsed instantiations only get expanded when they are found different.
+Children const &getChildren(GenericAstNode *node)
+{
+    if (node->mySharedNode != nullptr)
+    {
+        return node->mySharedNode->myChidren;
+    }
+    if (node->childrenComputer != nullptr)
+    {
+        node->expand();
+        for (auto &child : node->myChidren)
+        {
+            computeStructuralHashes(child.get());
+        }
+    }
+    return node->myChidren;
+}
+
+class DiffBuilder
+{
+public:
+    DiffBuilder(size_t maxEntries) : myRemainingEntries(maxEntries), isTruncated(false)
+    {
+    }
+
+    void diffNodes(GenericAstNode *left, GenericAstNode *right, AstDiffNode &result)
+    {
+        result.kind = AstDiffNode::Kind::Modified;
+        result.left = left;
+        result.right = right;
+        // Without recursion, since some trees are very deep. The children of the modified nodes are compared once
+        // all their siblings have been reported, so that the entries they are stored in no longer move.
+        std::vector<AstDiffNode *> toVisit{ &result };
+        while (!toVisit.empty() && !isTruncated)
+        {
+            auto modified = toVisit.back();
+            toVisit.pop_back();
+            diffChildren(getChildren(modified->left), getChildren(modified->right), modified->children);
+            for (auto child = modified->children.rbegin(); child != modified->children.rend(); ++child)
+            {
+                if (child->kind == AstDiffNode::Kind::Modified)
+                {
+                    toVisit.push_back(&*child);
+                }
+            }
+        }
+    }
+
+    bool truncated()
+    {
+        return isTruncated;
+    }
+
+private:
+    bool report(std::vector<AstDiffNode> &result, AstDiffNode::Kind kind, GenericAstNode *left, GenericAstNode *right)
+    {
+        if (myRemainingEntries == 0)
+        {
+            isTruncated = true;
+            return false;
+        }
+        --myRemainingEntries;
+        result.push_back(AstDiffNode{ kind, left, right, {} });
+        return true;
+    }
+
+    void diffChildren(Children const &left, Children const &right, std::vector<AstDiffNode> &result)
+    {
+        // Most of the time, differences are local: Skip the common prefix and suffix first
+        size_t begin = 0;
+        auto leftEnd = left.size();
+        auto rightEnd = right.size();
+        while (begin < leftEnd && begin < rightEnd && left[begin]->myStructuralHash == right[begin]->myStructuralHash)
+        {
+            ++begin;
+        }
+        while (leftEnd > begin && rightEnd > begin && left[leftEnd - 1]->myStructuralHash == right[rightEnd - 1]->myStructuralHash)
+        {
+            --leftEnd;
+            --rightEnd;
+        }
+        if (begin == leftEnd && begin == rightEnd)
+        {
+            return;
+        }
+
+        // Identical subtrees that just moved are not reported
+        std::unordered_multimap<uint64_t, size_t> rightByHash;
+        for (auto j = begin; j != rightEnd; ++j)
+        {
+            rightByHash.emplace(right[j]->myStructuralHash, j);
+        }
+        std::vector<size_t> unmatchedLeft;
+        for (auto i = begin; i != leftEnd; ++i)
+        {
+            auto it = rightByHash.find(left[i]->myStructuralHash);
+            if (it == rightByHash.end())
+            {
+                unmatchedLeft.push_back(i);
+            }
+            else
+            {
+                rightByHash.erase(it);
+            }
+        }
+        std::vector<size_t> unmatchedRight;
+        for (auto &remaining : rightByHash)
+        {
+            unmatchedRight.push_back(remaining.second);
+        }
+        std::sort(unmatchedRight.begin(), unmatchedRight.end());
+
+        // Remaining nodes are paired in order when they have the same name, the others have been added or removed
+        size_t j = 0;
+        for (auto i : unmatchedLeft)
+        {
+            auto k = j;
+            while (k < unmatchedRight.size() && k < j + pairingWindow && right[unmatchedRight[k]]->name != left[i]->name)
+            {
+                ++k;
+            }
+            if (k < unmatchedRight.size() && right[unmatchedRight[k]]->name == left[i]->name)
+            {
+                for (; j < k; ++j)
+                {
+                    if (!report(result, AstDiffNode::Kind::Added, nullptr, right[unmatchedRight[j]].get()))
+                    {
+                        return;
+                    }
+                }
+                if (!report(result, AstDiffNode::Kind::Modified, left[i].get(), right[unmatchedRight[k]].get()))
+                {
+                    return;
+                }
+                j = k + 1;
+            }
+            else if (!report(result, AstDiffNode::Kind::Removed, left[i].get(), nullptr))
+            {
+                return;
+            }
+        }
+        for (; j < unmatchedRight.size(); ++j)
+        {
+            if (!report(result, AstDiffNode::Kind::Added, nullptr, right[unmatchedRight[j]].get()))
+            {
+                return;
+            }
+        }
+    }
+
+    size_t myRemainingEntries;
+    bool isTruncated;
+};
+
+} // namespace
+
+
+void computeStructuralHashes(GenericAstNode *root)
+{
+    // Post order traversal, without recursion since some trees (long chains of binary operators...) are very deep
+    std::vector<std::pair<GenericAstNode *, bool>> toVisit{ { root, false } };
+    while (!toVisit.empty())
+    {
+        auto node = toVisit.back().first;
+        if (!toVisit.back().second)
+        {
+            toVisit.back().second = true;
+            // Shared nodes are used in many places, but only need to be hashed once. The children of a proxy
+            // are proxies of the children of the shared node, they are not needed.
+            if (node->mySharedNode != nullptr)
+            {
+                if (node->mySharedNode->myStructuralHash == 0)
+                {
+                    toVisit.emplace_back(node->mySharedNode, false);
+                }
+                continue;
+            }
+            for (auto &child : node->myChidren)
+            {
+                toVisit.emplace_back(child.get(), false);
+            }
+            continue;
+        }
+        toVisit.pop_back();
+        auto hash = computeOwnHash(node);
+        if (node->mySharedNode != nullptr)
+        {
+            // The same before and after the proxy is expanded
+            hash = hashValue(hash, node->mySharedNode->myStructuralHash);
+        }
+        else if (node->childrenComputer != nullptr)
+        {
+            hash = hashValue(hash, hashCollapsedChildren(node));
+        }
+        else
+        {
+            hash = hashValue(hash, node->myChidren.size());
+            for (auto &child : node->myChidren)
+            {
+                hash = hashValue(hash, child->myStructuralHash);
+            }
+        }
+        node->myStructuralHash = hash;
+    }
+}
+
+bool diffAsts(GenericAstNode *left, GenericAstNode *right, AstDiffNode &result, size_t maxEntries, bool &truncated)
+{
+    truncated = false;
+    if (left->myStructuralHash == right->myStructuralHash)
+    {
+        return false;
+    }
+    auto builder = DiffBuilder{ maxEntries };
+    builder.diffNodes(left, right, result);
+    truncated = builder.truncated();
+    return true;
+}
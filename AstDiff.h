@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "AstReader.h"
+
+// Structural comparison of two GenericAstNode trees, for instance the same code parsed with two
+// different command lines. Each subtree gets a hash computed from the names and properties of all
+// its nodes, but not from their positions, so that an insertion in the code does not change the hash
+// of everything that follows. Subtrees with the same hash are considered identical and never visited.
+// Shared type proxies are hashed as the node they share, and collapsed instantiations as their contents,
+// so that neither depends on what has been expanded.
+
+void computeStructuralHashes(GenericAstNode *root);
+
+struct AstDiffNode
+{
+    enum class Kind
+    {
+        Modified, // Same kind of node, with different properties or different children
+        Removed,
+        Added
+    };
+    Kind kind;
+    GenericAstNode *left; // nullptr for added nodes
+    GenericAstNode *right; // nullptr for removed nodes
+    std::vector<AstDiffNode> children; // Only for modified nodes
+};
+
+// Both trees must have their hashes computed. Return false if the trees are identical.
+// Collapsed instantiations that differ are expanded, so the trees should not be displayed yet.
+// At most maxEntries nodes are reported, truncated is set if some differences were not reported.
+bool diffAsts(GenericAstNode *left, GenericAstNode *right, AstDiffNode &result, size_t maxEntries, bool &truncated);
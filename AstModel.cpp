@@ -1,5 +1,6 @@
 #include "AstModel.h"
 #include <qbrush.h>
+#include "Trace.h"
 
 
 AstModel::AstModel(GenericAstNode *data, QObject *parent): 
@@ -19,16 +20,21 @@ int AstModel::columnCount(const QModelIndex &parent) const
 
 QVariant AstModel::data(const QModelIndex &index, int role) const
 {
+    TRACE_FREQUENT_SCOPE("AstModel::data");
     if (!index.isValid())
         return QVariant();
 
-    if (role != Qt::DisplayRole && role != Qt::ForegroundRole && role != Qt::NodeRole)
+    if (role != Qt::DisplayRole && role != Qt::ForegroundRole && role != Qt::BackgroundRole && role != Qt::NodeRole)
         return QVariant();
 
     auto item = static_cast<GenericAstNode*>(index.internalPointer());
     switch (role)
     {
     case Qt::DisplayRole:
+        if (!item->badge.empty())
+        {
+            return QVariant(QString::fromStdString(item->name + "  [" + item->badge + "]"));
+        }
         return QVariant(QString::fromStdString(item->name));
     case Qt::ForegroundRole:
         switch (item->getColor())
@@ -40,6 +46,8 @@ QVariant AstModel::data(const QModelIndex &index, int role) const
         default:
             return QVariant(QBrush(Qt::GlobalColor::black));
         }
+    case Qt::BackgroundRole:
+        return item->isHighlighted ? QVariant(QBrush(QColor(255, 220, 180))) : QVariant();
     case Qt::NodeRole:
         return QVariant::fromValue(item);
     }
@@ -64,6 +72,7 @@ QVariant AstModel::headerData(int section, Qt::Orientation orientation, int role
 
 QModelIndex AstModel::index(int row, int column, const QModelIndex &parent) const
 {
+    TRACE_FREQUENT_SCOPE("AstModel::index");
     if (!hasIndex(row, column, parent))
         return QModelIndex();
 
@@ -88,6 +97,7 @@ QModelIndex AstModel::rootIndex() const
 
 QModelIndex AstModel::parent(const QModelIndex &index) const
 {
+    TRACE_FREQUENT_SCOPE("AstModel::parent");
     if (!index.isValid())
         return QModelIndex();
 
@@ -135,7 +145,31 @@ bool AstModel::hasChildren(const QModelIndex &parent) const
     else
         parentItem = rootItem;
 
-    return !parentItem->myChidren.empty();
+    return !parentItem->myChidren.empty() || parentItem->canExpand();
+
+}
+
+bool AstModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return false;
+    auto parentItem = static_cast<GenericAstNode*>(parent.internalPointer());
+    return parentItem->canExpand();
+}
 
+void AstModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent))
+        return;
+    auto parentItem = static_cast<GenericAstNode*>(parent.internalPointer());
+    auto children = parentItem->createChildren();
+    if (children.empty())
+        return;
+    beginInsertRows(parent, 0, children.size() - 1);
+    for (auto &child : children)
+    {
+        parentItem->attach(std::move(child));
+    }
+    endInsertRows();
 }
 
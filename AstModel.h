@@ -27,6 +27,8 @@ public:
     int columnCount(const QModelIndex &parent = QModelIndex()) const override;
     QModelIndex rootIndex() const;
     bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
 
 private:
     void setupModelData(const QStringList &lines, GenericAstNode *parent);
@@ -1,7 +1,20 @@
 #include "AstReader.h"
 #include <sstream>
 #include "CommandLineSplitter.h"
+#include "AstSnapshot.h"
+#include "MatcherQuery.h"
+#include "CrossReferences.h"
+#include "IncludeProfiler.h"
+#include "RecordLayout.h"
+#include "HiddenCopies.h"
+#include "MoveAudit.h"
+#include "AllocationSites.h"
+#include "VirtualCalls.h"
+#include "Trace.h"
 #include <iostream>
+#include <algorithm>
+#include <set>
+#include <tuple>
 #include "ClangUtilities/StringLiteralExtractor.h"
 #include "ClangUtilities/TemplateUtilities.h"
 
@@ -13,6 +26,7 @@
 #include <clang/AST/RecursiveASTVisitor.h>
 #include <clang/Frontend/FrontendActions.h>
 #include <clang/AST/Decl.h>
+#include <clang/AST/DeclTemplate.h>
 #include <clang/Lex/Lexer.h>
 #include <clang/Basic/TargetInfo.h>
 #include <clang/Frontend/CompilerInstance.h>
@@ -33,6 +47,8 @@ namespace props
     std::string const IsTemplateDecl = "Is template declaration";
     std::string const IsGenerated = "Generated";
     std::string const Type = "Type";
+    std::string const InstantiatedNodes = "Instantiated nodes";
+    std::string const Instantiations = "Instantiations";
 }
 
 
@@ -70,8 +86,10 @@ std::string getCFG(clang::FunctionDecl const *FD)
 
 
 
+std::atomic<unsigned> GenericAstNode::ourExpansionCount(0);
+
 GenericAstNode::GenericAstNode() :
-myParent(nullptr), hasDetails(false)
+myParent(nullptr), hasDetails(false), isHighlighted(false), myStructuralHash(0), mySharedNode(nullptr), myIsDetached(false), myIsInMainFile(false), myColor(0)
 {
 
 }
@@ -114,10 +132,15 @@ bool GenericAstNode::getRangeInMainFile(std::pair<int, int> &result, clang::Sour
         return false;
     }
     auto start = manager.getDecomposedSpellingLoc(range.getBegin());
+    // Nodes deserialized from a module point to headers whose content may not even be loaded, we must not lex there
+    if (start.first != manager.getMainFileID() || manager.getFileID(manager.getSpellingLoc(range.getEnd())) != start.first)
+    {
+        //Not in the same file, or not in the main file (probably #included, or imported)
+        return false;
+    }
     auto end = manager.getDecomposedSpellingLoc(clang::Lexer::getLocForEndOfToken(range.getEnd(), 0, manager, context.getLangOpts()));
-    if (start.first != end.first || start.first != manager.getMainFileID())
+    if (start.first != end.first)
     {
-        //Not in the same file, or not in the main file (probably #included)
         return false;
     }
     result = std::make_pair(start.second, end.second);
@@ -139,9 +162,131 @@ struct NodeColorVisitor : boost::static_visitor<int>
 
 int GenericAstNode::getColor()
 {
+    if (myIsDetached)
+    {
+        return myColor;
+    }
     return boost::apply_visitor(NodeColorVisitor(), myAstNode);
 }
 
+void GenericAstNode::detach(clang::SourceManager const &manager, clang::ASTContext &context, bool computeDetails)
+{
+    if (myIsDetached)
+    {
+        return;
+    }
+    myIsInMainFile = getRangeInMainFile(myRangeInMainFile, manager, context);
+    myColor = getColor();
+    getProperties(); // Lazy properties need clang
+    if (hasDetails)
+    {
+        // Details are only worth precomputing for code the user can actually see
+        if (computeDetails && myIsInMainFile && details.empty())
+        {
+            details = detailsComputer();
+        }
+        hasDetails = !details.empty();
+        detailsComputer = nullptr;
+    }
+    myAstNode = static_cast<clang::Decl *>(nullptr);
+    myIsDetached = true;
+}
+
+bool GenericAstNode::isDetached() const
+{
+    return myIsDetached;
+}
+
+bool GenericAstNode::getDetachedRangeInMainFile(std::pair<int, int> &result) const
+{
+    result = myRangeInMainFile;
+    return myIsDetached && myIsInMainFile;
+}
+
+bool GenericAstNode::canExpand() const
+{
+    return myChidren.empty() &&
+        (childrenComputer != nullptr || (mySharedNode != nullptr && !mySharedNode->myChidren.empty()));
+}
+
+std::vector<std::unique_ptr<GenericAstNode>> GenericAstNode::createChildren()
+{
+    std::vector<std::unique_ptr<GenericAstNode>> result;
+    if (!canExpand())
+    {
+        return result;
+    }
+    ++ourExpansionCount;
+    if (childrenComputer != nullptr)
+    {
+        result = childrenComputer();
+        childrenComputer = nullptr;
+        return result;
+    }
+    for (auto &sharedChild : mySharedNode->myChidren)
+    {
+        auto proxy = std::make_unique<GenericAstNode>();
+        proxy->name = sharedChild->name;
+        proxy->kind = sharedChild->kind;
+        proxy->myAstNode = sharedChild->myAstNode;
+        proxy->hasDetails = sharedChild->hasDetails;
+        proxy->detailsTitle = sharedChild->detailsTitle;
+        proxy->details = sharedChild->details;
+        proxy->detailsComputer = sharedChild->detailsComputer;
+        proxy->myStructuralHash = sharedChild->myStructuralHash;
+        proxy->myProperties = sharedChild->getProperties();
+        proxy->myIsDetached = sharedChild->myIsDetached;
+        proxy->myIsInMainFile = sharedChild->myIsInMainFile;
+        proxy->myRangeInMainFile = sharedChild->myRangeInMainFile;
+        proxy->myColor = sharedChild->myColor;
+        // Proxies are expanded lazily too, the grand children will be created when they are needed
+        proxy->mySharedNode = sharedChild->mySharedNode != nullptr ? sharedChild->mySharedNode : sharedChild.get();
+        result.push_back(std::move(proxy));
+    }
+    return result;
+}
+
+unsigned GenericAstNode::getExpansionCount()
+{
+    return ourExpansionCount;
+}
+
+void GenericAstNode::expand()
+{
+    for (auto &child : createChildren())
+    {
+        attach(std::move(child));
+    }
+}
+
+void GenericAstNode::expandInstantiations()
+{
+    // Shared types are left alone, their proxies would only duplicate subtrees that are already in the tree
+    std::vector<GenericAstNode *> toVisit{ this };
+    while (!toVisit.empty())
+    {
+        auto node = toVisit.back();
+        toVisit.pop_back();
+        if (node->childrenComputer != nullptr)
+        {
+            node->expand();
+        }
+        for (auto &child : node->myChidren)
+        {
+            toVisit.push_back(child.get());
+        }
+    }
+}
+
+void GenericAstNode::restoreDetached(bool isInMainFile, std::pair<int, int> const &range, int color)
+{
+    myAstNode = static_cast<clang::Decl *>(nullptr);
+    myIsInMainFile = isInMainFile;
+    myRangeInMainFile = range;
+    myColor = color;
+    myIsDetached = true;
+}
+
 
 void GenericAstNode::setProperty(std::string const &propertyName, std::string const &value)
 {
@@ -150,19 +295,154 @@ void GenericAstNode::setProperty(std::string const &propertyName, std::string co
 
 GenericAstNode::Properties const &GenericAstNode::getProperties() const
 {
+    if (myLazyProperties)
+    {
+        auto computer = std::move(myLazyProperties);
+        myLazyProperties = nullptr;
+        computer(myProperties);
+    }
     return myProperties;
 }
 
+void GenericAstNode::setLazyProperties(std::function<void(Properties &)> const &computer)
+{
+    if (myLazyProperties)
+    {
+        auto previous = myLazyProperties;
+        myLazyProperties = [previous, computer](Properties &properties) {previous(properties); computer(properties); };
+    }
+    else
+    {
+        myLazyProperties = computer;
+    }
+}
+
+
+
 
+// Return the template a declaration is an instantiation of, or nullptr if it is not an instantiation
+clang::Decl const *getInstantiatedTemplate(clang::Decl *decl)
+{
+    if (auto spec = dyn_cast<ClassTemplateSpecializationDecl>(decl))
+    {
+        if (isa<ClassTemplatePartialSpecializationDecl>(spec) || !clang::isTemplateInstantiation(spec->getSpecializationKind()))
+        {
+            return nullptr;
+        }
+        return spec->getSpecializedTemplate();
+    }
+    if (auto FD = dyn_cast<FunctionDecl>(decl))
+    {
+        if (!FD->isTemplateInstantiation())
+        {
+            return nullptr;
+        }
+        if (auto primary = FD->getPrimaryTemplate())
+        {
+            return primary;
+        }
+        return FD->getTemplateInstantiationPattern(); // Member of a class template
+    }
+    return nullptr;
+}
+
+// Counts the nodes an instantiation would create in the tree, without creating them. Nested instantiations
+// are accounted for in the statistics of their own template too.
+class InstantiationCounter : public RecursiveASTVisitor<InstantiationCounter>
+{
+public:
+    using PARENT = clang::RecursiveASTVisitor<InstantiationCounter>;
+    InstantiationCounter(InstantiationStats &stats) : myStats(stats)
+    {
+        myCounts.push_back(0);
+    }
+
+    bool shouldVisitTemplateInstantiations() const
+    {
+        return true;
+    }
+
+    bool shouldVisitImplicitCode() const
+    {
+        return true;
+    }
+
+    unsigned count(clang::Decl *instantiation)
+    {
+        TraverseDecl(instantiation);
+        return myStats.nodeCounts[instantiation];
+    }
+
+    bool TraverseDecl(clang::Decl *decl)
+    {
+        if (decl == nullptr)
+        {
+            return PARENT::TraverseDecl(decl);
+        }
+        auto instantiatedTemplate = getInstantiatedTemplate(decl);
+        if (instantiatedTemplate == nullptr)
+        {
+            ++myCounts.back();
+            return PARENT::TraverseDecl(decl);
+        }
+        auto known = myStats.nodeCounts.find(decl);
+        if (known != myStats.nodeCounts.end())
+        {
+            myCounts.back() += known->second;
+            return true;
+        }
+        myCounts.push_back(1);
+        auto res = PARENT::TraverseDecl(decl);
+        auto nodes = myCounts.back();
+        myCounts.pop_back();
+        myCounts.back() += nodes;
+
+        myStats.nodeCounts[decl] = nodes;
+        auto &bloat = myStats.byTemplate[instantiatedTemplate];
+        if (bloat.instantiations == 0)
+        {
+            bloat.templateName = cast<NamedDecl>(instantiatedTemplate)->getQualifiedNameAsString();
+        }
+        ++bloat.instantiations;
+        bloat.nodes += nodes;
+        return res;
+    }
+
+    bool TraverseStmt(clang::Stmt *stmt)
+    {
+        if (stmt != nullptr)
+        {
+            ++myCounts.back();
+        }
+        return PARENT::TraverseStmt(stmt);
+    }
+
+    bool TraverseType(clang::QualType type)
+    {
+        // Type subtrees are shared (see SharedTypeNodes), each use only costs one node
+        if (!type.isNull())
+        {
+            ++myCounts.back();
+        }
+        return true;
+    }
+
+private:
+    InstantiationStats &myStats;
+    std::vector<unsigned> myCounts;
+};
 
 
 class AstDumpVisitor : public RecursiveASTVisitor<AstDumpVisitor>
 {
 public:
     using PARENT = clang::RecursiveASTVisitor<AstDumpVisitor>;
-    AstDumpVisitor(clang::ASTContext &context, GenericAstNode *rootNode) :
+    AstDumpVisitor(clang::ASTContext &context, GenericAstNode *rootNode, SharedTypeNodes &sharedTypes, InstantiationStats *instantiationStats, unsigned cacheLineSize) :
         myRootNode(rootNode),
-        myAstContext(context)
+        myAstContext(context),
+        mySharedTypes(sharedTypes),
+        myInstantiationStats(instantiationStats),
+        myCacheLineSize(cacheLineSize)
     {
         myStack.push_back(myRootNode);
     }
@@ -239,9 +519,13 @@ public:
         {
             return PARENT::TraverseDecl(decl);
         }
+        auto isTopLevel = trace::isRecording() && decl->getDeclContext() != nullptr && decl->getDeclContext()->isTranslationUnit();
+        auto namedDecl = isTopLevel ? dyn_cast<NamedDecl>(decl) : nullptr;
+        trace::DetailScope traceScope(isTopLevel ? "AstDumpVisitor::TraverseDecl" : nullptr, namedDecl != nullptr ? namedDecl->getNameAsString() : std::string());
         auto node = std::make_unique<GenericAstNode>();
         node->myAstNode = decl;
-        node->name = decl->getDeclKindName() + std::string("Decl"); // Try to mimick clang default dump
+        node->kind = decl->getDeclKindName() + std::string("Decl"); // Try to mimick clang default dump
+        node->name = node->kind;
         if (auto *FD = dyn_cast<FunctionDecl>(decl))
         {
 #ifndef NDEBUG
@@ -333,6 +617,24 @@ public:
             node->setProperty(props::Name, ND->getNameAsString());
         }
 
+        if (myInstantiationStats != nullptr)
+        {
+            if (isa<RedeclarableTemplateDecl>(decl) || (isa<FunctionDecl>(decl) && cast<FunctionDecl>(decl)->isDependentContext()))
+            {
+                myInstantiationStats->templateNodes[decl] = node.get();
+            }
+            if (getInstantiatedTemplate(decl) != nullptr)
+            {
+                // The stub gets the same properties (layout, template...) as a node that is not collapsed
+                myStack.push_back(node.get());
+                walkUpFrom(decl);
+                myStack.pop_back();
+                collapse(node.get(), decl);
+                myStack.back()->attach(std::move(node));
+                return true;
+            }
+        }
+
         auto nodePtr = node.get();
         myStack.back()->attach(std::move(node));
         myStack.push_back(nodePtr);
@@ -341,6 +643,42 @@ public:
         return res;
     }
 
+    // Only the children of the declaration are added under myRootNode, used to expand collapsed nodes. The Visit*
+    // callbacks for the declaration itself apply to myRootNode, they were already applied to the stub by walkUpFrom
+    bool TraverseChildren(clang::Decl *decl)
+    {
+        return PARENT::TraverseDecl(decl);
+    }
+
+    // Calls the Visit* callbacks for the declaration, without traversing it, the same dispatch as in PARENT::TraverseDecl
+    bool walkUpFrom(clang::Decl *decl)
+    {
+        switch (decl->getKind())
+        {
+#define ABSTRACT_DECL(DECL)
+#define DECL(CLASS, BASE) case clang::Decl::CLASS: return WalkUpFrom##CLASS##Decl(static_cast<clang::CLASS##Decl *>(decl));
+#include <clang/AST/DeclNodes.inc>
+        }
+        return true;
+    }
+
+    void collapse(GenericAstNode *node, clang::Decl *instantiation)
+    {
+        auto counter = InstantiationCounter{ *myInstantiationStats };
+        node->setProperty(props::InstantiatedNodes, std::to_string(counter.count(instantiation)));
+        auto &context = myAstContext;
+        auto &sharedTypes = mySharedTypes;
+        auto stats = myInstantiationStats;
+        auto cacheLineSize = myCacheLineSize;
+        node->childrenComputer = [&context, &sharedTypes, stats, instantiation, cacheLineSize]()
+        {
+            GenericAstNode temporaryRoot;
+            auto visitor = AstDumpVisitor{ context, &temporaryRoot, sharedTypes, stats, cacheLineSize };
+            visitor.TraverseChildren(instantiation);
+            return std::move(temporaryRoot.myChidren);
+        };
+    }
+
     bool TraverseStmt(clang::Stmt *stmt)
     {
         if (stmt == nullptr)
@@ -349,7 +687,8 @@ public:
         }
         auto node = std::make_unique<GenericAstNode>();
         node->myAstNode = stmt;
-        node->name = stmt->getStmtClassName();
+        node->kind = stmt->getStmtClassName();
+        node->name = node->kind;
         auto nodePtr = node.get();
         myStack.back()->attach(std::move(node));
         myStack.push_back(nodePtr);
@@ -362,22 +701,27 @@ public:
     {
         myStack.back()->name += (" " + s->getBytes()).str();
         myStack.back()->setProperty(props::InterpretedValue, s->getBytes());
-        auto parts = clang_utilities::splitStringLiteral(s, myAstContext.getSourceManager(), myAstContext.getLangOpts(), myAstContext.getTargetInfo());
-        if (parts.size() == 1)
+        // Splitting the literal requires to go back to the source, it is only done if the user looks at this node
+        auto &context = myAstContext;
+        myStack.back()->setLazyProperties([s, &context](GenericAstNode::Properties &properties)
         {
-            myStack.back()->setProperty(props::Value, parts[0]);
+            auto parts = clang_utilities::splitStringLiteral(s, context.getSourceManager(), context.getLangOpts(), context.getTargetInfo());
+            if (parts.size() == 1)
+            {
+                properties[props::Value] = parts[0];
 
-        }
-        else
-        {
-            int i = 0;
-            for (auto &part : parts)
+            }
+            else
             {
-                ++i;
-                myStack.back()->setProperty(props::Value + " " + std::to_string(i), part);
+                int i = 0;
+                for (auto &part : parts)
+                {
+                    ++i;
+                    properties[props::Value + " " + std::to_string(i)] = part;
 
+                }
             }
-        }
+        });
         return true;
     }
 
@@ -406,6 +750,29 @@ public:
         return true;
     }
 
+    bool VisitRecordDecl(clang::RecordDecl *r)
+    {
+        if (r->isCompleteDefinition() && !r->isDependentType() && !r->isInvalidDecl())
+        {
+            auto node = myStack.back();
+            auto cacheLineSize = myCacheLineSize;
+            auto cxxRecord = dyn_cast<CXXRecordDecl>(r);
+            auto isDynamic = cxxRecord != nullptr && cxxRecord->isDynamicClass();
+            node->hasDetails = true;
+            node->detailsTitle = isDynamic ? "Record layout and virtual table" : "Record layout";
+            node->detailsComputer = [r, cxxRecord, isDynamic, cacheLineSize]()
+            {
+                auto details = describeRecordLayout(r, r->getASTContext(), cacheLineSize);
+                if (isDynamic)
+                {
+                    details += "\n" + describeVTableLayout(cxxRecord, r->getASTContext());
+                }
+                return details;
+            };
+        }
+        return true;
+    }
+
 
     void addReference(GenericAstNode *node, clang::NamedDecl *referenced, std::string const &label)
     {
@@ -429,14 +796,25 @@ public:
         {
             return PARENT::TraverseType(type);
         }
+        // The exact QualType is used as a key, not the canonical one, since sugar (typedefs...) is part of the subtree
+        auto res = true;
+        auto &shared = mySharedTypes.index[type.getAsOpaquePtr()];
+        if (shared == nullptr)
+        {
+            auto sharedNode = std::make_unique<GenericAstNode>();
+            sharedNode->kind = type->getTypeClassName();
+            sharedNode->name = sharedNode->kind;
+            shared = sharedNode.get();
+            mySharedTypes.roots.push_back(std::move(sharedNode));
+            myStack.push_back(shared);
+            res = PARENT::TraverseType(type);
+            myStack.pop_back();
+        }
         auto node = std::make_unique<GenericAstNode>();
-        //node->myType = d;
-        node->name = type->getTypeClassName();
-        auto nodePtr = node.get();
+        node->name = shared->name;
+        node->kind = shared->kind;
+        node->mySharedNode = shared;
         myStack.back()->attach(std::move(node));
-        myStack.push_back(nodePtr);
-        auto res = PARENT::TraverseType(type);
-        myStack.pop_back();
         return res;
     }
 
@@ -444,10 +822,13 @@ private:
     std::vector<GenericAstNode*> myStack;
     GenericAstNode *myRootNode;
     ASTContext &myAstContext;
+    SharedTypeNodes &mySharedTypes;
+    InstantiationStats *myInstantiationStats; // nullptr if instantiations are not collapsed
+    unsigned myCacheLineSize; // For the record layouts
 };
 
 
-AstReader::AstReader() : isReady(false)
+AstReader::AstReader() : myCachedArgsUseResponseFiles(false), myIndexedExpansions(0), myProfileIncludes(false), myProfileMacros(false), myCacheLineSize(64), myCollapseInstantiations(false), isReady(false), myDetachedMode(false), myPrecomputeCfgWhenDetached(false), myTreeVersion(0), myRemarksTreeVersion(0)
 {
 }
 
@@ -471,7 +852,7 @@ GenericAstNode *AstReader::findPosInChildren(std::vector<std::unique_ptr<Generic
     for (auto &candidate : candidates)
     {
         std::pair<int, int> location;
-        if (!candidate->getRangeInMainFile(location, getManager(), getContext()))
+        if (!getRangeInMainFile(candidate.get(), location))
         {
             continue;
         }
@@ -485,6 +866,7 @@ GenericAstNode *AstReader::findPosInChildren(std::vector<std::unique_ptr<Generic
 
 std::vector<GenericAstNode *> AstReader::getBestNodeMatchingPosition(int position)
 {
+    TRACE_SCOPE("AstReader::getBestNodeMatchingPosition");
     std::vector<GenericAstNode *> result;
     auto currentNode = getRealRoot();
     result.push_back(currentNode);
@@ -504,33 +886,562 @@ std::vector<GenericAstNode *> AstReader::getBestNodeMatchingPosition(int positio
 
 GenericAstNode *AstReader::readAst(std::string const &sourceCode, std::string const &options)
 {
+    TRACE_SCOPE("AstReader::readAst");
+    discardFunctionWeights();
+    ++myTreeVersion;
+    myBadgedNodes.clear();
+    myLoopDepths.reset();
     mySourceCode = sourceCode;
+    mySharedTypeNodes = SharedTypeNodes{};
+    myInstantiationStats = InstantiationStats{};
+    myNodesByAstNode.clear();
+    myXRefs = XRefTable{};
     myArtificialRoot = std::make_unique<GenericAstNode>();
     auto root = std::make_unique<GenericAstNode>();
     root->name = "AST";
     myArtificialRoot->attach(std::move(root));
 
-    auto args = splitCommandLine(options);
+    // Response files may have changed since the last time, only plain command lines can be reused
+    if (options != myCachedOptions || myCachedArgsUseResponseFiles)
+    {
+        myCachedArgs = splitCommandLine(options, &myCachedArgsUseResponseFiles, &myCommandLineError);
+        myCachedOptions = options;
+    }
+    auto args = myCachedArgs;
+    auto moduleArgs = myModuleCache.arguments();
+    args.insert(args.end(), moduleArgs.begin(), moduleArgs.end());
+    myLastArgs = args;
 
     std::cout << "Launching Clang to create AST" << std::endl;
-    myAst = clang::tooling::buildASTFromCodeWithArgs(mySourceCode, args);
-    if (myAst != nullptr)
+    myIncludeProfiler = IncludeProfiler{};
+    myMacroProfiler = MacroProfiler{};
+    std::function<void(clang::CompilerInstance &)> beforeParse;
+    if (myProfileIncludes || myProfileMacros)
     {
-        for (auto it = myAst->top_level_begin(); it != myAst->top_level_end(); ++it)
+        beforeParse = [this](clang::CompilerInstance &instance)
         {
-            //(*it)->dumpColor();
-        }
+            if (myProfileIncludes)
+            {
+                myIncludeProfiler.install(instance);
+            }
+            if (myProfileMacros)
+            {
+                myMacroProfiler.install(instance);
+            }
+        };
+    }
+    {
+        TRACE_SCOPE("ParseCache::buildAst");
+        myModuleCache.beforeParse();
+        myParseError.clear();
+        myAst = myParseCache.buildAst(mySourceCode, args, myParseError, beforeParse);
+        myModuleCache.afterParse(myAst.get());
+    }
+    if (myAst != nullptr)
+    {
         std::cout << "Visiting AST and creating Qt Tree" << std::endl;
-        auto visitor = AstDumpVisitor{ myAst->getASTContext(), getRealRoot() };
+        auto collapse = myCollapseInstantiations && !myDetachedMode;
+        auto visitor = AstDumpVisitor{ myAst->getASTContext(), getRealRoot(), mySharedTypeNodes, collapse ? &myInstantiationStats : nullptr, myCacheLineSize };
         visitor.TraverseDecl(myAst->getASTContext().getTranslationUnitDecl());
+        myXRefs = XRefTable{};
+        {
+            TRACE_SCOPE("collectXRefs");
+            collectXRefs(myAst->getASTContext(), myXRefs);
+        }
+        myIncludeProfiler.finish(myArtificialRoot.get(), myAst->getASTContext());
+        myMacroProfiler.finish(myArtificialRoot.get(), myAst->getSourceManager());
+        for (auto &bloat : myInstantiationStats.byTemplate)
+        {
+            auto templateNode = myInstantiationStats.templateNodes.find(bloat.first);
+            if (templateNode != myInstantiationStats.templateNodes.end())
+            {
+                bloat.second.templateNode = templateNode->second;
+                templateNode->second->setProperty(props::Instantiations, std::to_string(bloat.second.instantiations));
+                templateNode->second->setProperty(props::InstantiatedNodes, std::to_string(bloat.second.nodes));
+            }
+        }
+        if (myDetachedMode)
+        {
+            std::cout << "Detaching tree from Clang" << std::endl;
+            detachTree();
+        }
     }
     isReady = true;
     return myArtificialRoot.get();
 }
 
+void AstReader::invalidateParseCache()
+{
+    myParseCache.invalidate();
+}
+
+unsigned AstReader::getSavedStatCount()
+{
+    return myParseCache.lastSavedStats();
+}
+
+void AstReader::setUseModules(bool useModules)
+{
+    myModuleCache.setEnabled(useModules);
+}
+
+void AstReader::setModuleCacheLocation(std::string const &directory, uint64_t sizeLimit)
+{
+    myModuleCache.setLocation(directory, sizeLimit);
+}
+
+std::string const &AstReader::getModuleCacheDirectory()
+{
+    return myModuleCache.directory();
+}
+
+uint64_t AstReader::getModuleCacheSizeLimit()
+{
+    return myModuleCache.sizeLimit();
+}
+
+std::string const &AstReader::getParseError()
+{
+    return myParseError;
+}
+
+void AstReader::copySettings(AstReader const &other)
+{
+    myModuleCache.copySettings(other.myModuleCache);
+    myProfileIncludes = other.myProfileIncludes;
+    myProfileMacros = other.myProfileMacros;
+    myCacheLineSize = other.myCacheLineSize;
+    myCollapseInstantiations = other.myCollapseInstantiations;
+    myDetachedMode = other.myDetachedMode;
+    myPrecomputeCfgWhenDetached = other.myPrecomputeCfgWhenDetached;
+}
+
+std::string const &AstReader::getCommandLineError()
+{
+    return myCommandLineError;
+}
+
+bool AstReader::hitModuleCache()
+{
+    return myModuleCache.lastParseHitCache();
+}
+
+std::vector<ModuleUse> const &AstReader::getLastParseModules()
+{
+    return myModuleCache.lastParseModules();
+}
+
+void AstReader::setProfileIncludes(bool profile)
+{
+    myProfileIncludes = profile;
+}
+
+IncludeProfileNode const *AstReader::getIncludeProfile()
+{
+    return myIncludeProfiler.root();
+}
+
+void AstReader::setProfileMacros(bool profile)
+{
+    myProfileMacros = profile;
+}
+
+std::vector<MacroProfileEntry> const *AstReader::getMacroProfile()
+{
+    return myMacroProfiler.entries();
+}
+
+bool AstReader::startFunctionWeights()
+{
+    if (!ready() || isDetached())
+    {
+        return false;
+    }
+    auto root = getRealRoot();
+    auto &context = getContext();
+    // Instantiations of the templates of the main file are weighted too. They are expanded here, since the
+    // computation does not modify the tree
+    root->expandInstantiations();
+    myFunctionWeights = std::async(std::launch::async, [root, &context]() {return computeFunctionWeights(root, context); });
+    return true;
+}
+
+bool AstReader::computingFunctionWeights()
+{
+    return myFunctionWeights.valid();
+}
+
+bool AstReader::functionWeightsComputed()
+{
+    return myFunctionWeights.valid() && myFunctionWeights.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+AnalysisReport AstReader::takeFunctionWeightsReport()
+{
+    AnalysisReport report;
+    report.title = "Function weights";
+    report.headers = { "Function", "Line", "Nodes", "Instantiations", "CFG blocks", "Lambdas" };
+    if (!myFunctionWeights.valid())
+    {
+        return report;
+    }
+    auto weights = myFunctionWeights.get();
+    std::stable_sort(weights.begin(), weights.end(), [](FunctionWeight const &w1, FunctionWeight const &w2) {return w1.nodes > w2.nodes; });
+    for (auto &weight : weights)
+    {
+        report.rows.push_back(AnalysisReport::Row{ weight.node, {
+            weight.node->name,
+            std::to_string(weight.line),
+            std::to_string(weight.nodes),
+            std::to_string(weight.instantiations),
+            std::to_string(weight.cfgBlocks),
+            std::to_string(weight.lambdas) } });
+    }
+    return report;
+}
+
+void AstReader::setCacheLineSize(unsigned size)
+{
+    myCacheLineSize = size;
+}
+
+AnalysisReport AstReader::getRecordPaddingReport()
+{
+    AnalysisReport report;
+    report.title = "Record padding";
+    report.headers = { "Record", "Size", "Alignment", "Padding", "Size after reordering", "Saved", "Cache lines", "Members crossing a cache line" };
+    std::vector<std::pair<GenericAstNode *, RecordPadding>> paddings;
+    std::vector<GenericAstNode *> toVisit{ getRealRoot() };
+    while (!toVisit.empty())
+    {
+        auto node = toVisit.back();
+        toVisit.pop_back();
+        for (auto &child : node->myChidren)
+        {
+            toVisit.push_back(child.get());
+        }
+        auto decl = boost::get<clang::Decl *>(&node->myAstNode);
+        auto record = decl != nullptr ? dyn_cast_or_null<RecordDecl>(*decl) : nullptr;
+        RecordPadding padding;
+        if (record != nullptr && computeRecordPadding(record, getContext(), myCacheLineSize, padding) && padding.padding > 0)
+        {
+            paddings.emplace_back(node, padding);
+        }
+    }
+    // Worst first: What can be saved matters more than what is only padding
+    std::sort(paddings.begin(), paddings.end(), [](std::pair<GenericAstNode *, RecordPadding> const &p1, std::pair<GenericAstNode *, RecordPadding> const &p2)
+    {
+        return std::make_tuple(p1.second.size - p1.second.reorderedSize, p1.second.padding) > std::make_tuple(p2.second.size - p2.second.reorderedSize, p2.second.padding);
+    });
+    for (auto &padding : paddings)
+    {
+        auto &p = padding.second;
+        report.rows.push_back(AnalysisReport::Row{ padding.first, {
+            padding.first->name,
+            std::to_string(p.size),
+            std::to_string(p.alignment),
+            std::to_string(p.padding),
+            std::to_string(p.reorderedSize),
+            std::to_string(p.size - p.reorderedSize),
+            std::to_string(p.cacheLines),
+            std::to_string(p.crossingMembers) } });
+    }
+    return report;
+}
+
+AnalysisReport AstReader::getHiddenCopiesReport(uint64_t minSize)
+{
+    AnalysisReport report;
+    report.title = "Hidden copies of at least " + std::to_string(minSize) + " bytes";
+    report.headers = { "Kind", "Type", "Size", "Position" };
+    // Copies made in the body of a collapsed instantiation are in the main file too
+    getRealRoot()->expandInstantiations();
+    auto copies = findHiddenCopies(getRealRoot(), getContext(), minSize);
+    std::stable_sort(copies.begin(), copies.end(), [](HiddenCopy const &c1, HiddenCopy const &c2) {return c1.size > c2.size; });
+    for (auto &copy : copies)
+    {
+        report.rows.push_back(AnalysisReport::Row{ copy.node, { copy.kind, copy.type, std::to_string(copy.size), copy.position } });
+    }
+    return report;
+}
+
+AnalysisReport AstReader::getMoveAuditReport()
+{
+    AnalysisReport report;
+    report.title = "Move audit";
+    report.headers = { "Record", "Move constructor", "Move assignment", "Problems", "Containers", "Stored in" };
+    auto issues = auditMoves(getRealRoot(), getContext());
+    // Types stored in containers are the ones that get copied on reallocations
+    std::stable_sort(issues.begin(), issues.end(), [](MoveIssue const &i1, MoveIssue const &i2) {return i1.containers.size() > i2.containers.size(); });
+    size_t const maxListedContainers = 5;
+    for (auto &issue : issues)
+    {
+        std::string storedIn;
+        for (size_t i = 0; i < issue.containers.size() && i < maxListedContainers; ++i)
+        {
+            storedIn += (i == 0 ? "" : ", ") + issue.containers[i];
+        }
+        if (issue.containers.size() > maxListedContainers)
+        {
+            storedIn += "...";
+        }
+        report.rows.push_back(AnalysisReport::Row{ issue.node, {
+            issue.record,
+            issue.moveConstructor,
+            issue.moveAssignment,
+            issue.problems,
+            std::to_string(issue.containers.size()),
+            storedIn } });
+    }
+    return report;
+}
+
+AnalysisReport AstReader::getAllocationSitesReport()
+{
+    AnalysisReport report;
+    report.title = "Allocation sites";
+    report.headers = { "Kind", "Allocated", "Loop depth", "Function", "Position" };
+    // Allocations in the body of a collapsed instantiation are in the main file too
+    getRealRoot()->expandInstantiations();
+    auto sites = findAllocationSites(getRealRoot(), getContext());
+    std::stable_sort(sites.begin(), sites.end(), [](AllocationSite const &s1, AllocationSite const &s2) {return s1.loopDepth > s2.loopDepth; });
+    for (auto &site : sites)
+    {
+        report.rows.push_back(AnalysisReport::Row{ site.node, { site.kind, site.allocated, std::to_string(site.loopDepth), site.function, site.position } });
+    }
+    return report;
+}
+
+AnalysisReport AstReader::getVirtualCallsReport()
+{
+    AnalysisReport report;
+    report.title = "Virtual calls";
+    report.headers = { "Callee / Position", "Verdict", "Loop depth", "Calls", "Devirtualizable", "Function" };
+    std::map<std::string, std::vector<VirtualCallSite>> byCallee;
+    // Calls in the body of a collapsed instantiation are in the main file too
+    getRealRoot()->expandInstantiations();
+    for (auto &call : findVirtualCalls(getRealRoot(), getContext()))
+    {
+        byCallee[call.callee].push_back(call);
+    }
+    std::vector<std::pair<unsigned, AnalysisReport::Row>> groups; // With the maximum loop depth of their calls
+    for (auto &callee : byCallee)
+    {
+        AnalysisReport::Row group{ nullptr, {}, {} };
+        unsigned devirtualizable = 0;
+        unsigned maxLoopDepth = 0;
+        for (auto &call : callee.second)
+        {
+            devirtualizable += call.devirtualizable ? 1 : 0;
+            maxLoopDepth = std::max(maxLoopDepth, call.loopDepth);
+            group.children.push_back(AnalysisReport::Row{ call.node, { call.position, call.verdict, std::to_string(call.loopDepth), "", "", call.function } });
+        }
+        group.cells = { callee.first, "", std::to_string(maxLoopDepth), std::to_string(callee.second.size()), std::to_string(devirtualizable), "" };
+        groups.emplace_back(maxLoopDepth, std::move(group));
+    }
+    // Calls in loops are the ones worth looking at
+    std::stable_sort(groups.begin(), groups.end(), [](std::pair<unsigned, AnalysisReport::Row> const &g1, std::pair<unsigned, AnalysisReport::Row> const &g2)
+    {
+        return g1.first > g2.first;
+    });
+    for (auto &group : groups)
+    {
+        report.rows.push_back(std::move(group.second));
+    }
+    return report;
+}
+
+bool AstReader::getFunctionCode(GenericAstNode *node, std::string const &optimization, std::shared_ptr<FunctionCode const> &result, std::string &error)
+{
+    result = nullptr;
+    if (isDetached())
+    {
+        error = "The code generation requires a live AST";
+        return false;
+    }
+    auto &manager = getManager();
+    auto &langOptions = getContext().getLangOpts();
+    // Keys of the function in node, and of all the functions that will be cached with it
+    auto getKey = [&](GenericAstNode *candidate, std::string &mangling, uint64_t &key)
+    {
+        auto decl = boost::get<clang::Decl *>(&candidate->myAstNode);
+        auto function = decl != nullptr ? dyn_cast_or_null<FunctionDecl>(*decl) : nullptr;
+        if (function == nullptr || !function->doesThisDeclarationHaveABody() || function->isDependentContext() || function->isInvalidDecl())
+        {
+            return false;
+        }
+        auto property = candidate->getProperties().find(props::Mangling);
+        if (property == candidate->getProperties().end() || property->second.empty() || property->second[0] == '<')
+        {
+            return false;
+        }
+        mangling = property->second;
+        auto text = Lexer::getSourceText(CharSourceRange::getTokenRange(function->getSourceRange()), manager, langOptions);
+        key = CodeGenCache::computeKey(mangling, text.str(), myLastArgs, optimization);
+        return true;
+    };
+    std::string mangling;
+    uint64_t key;
+    if (!getKey(node, mangling, key))
+    {
+        error = "Only the definitions of functions that are not templates have code";
+        return false;
+    }
+    result = myCodeGenCache.find(key);
+    if (result != nullptr)
+    {
+        return true;
+    }
+    std::unordered_map<std::string, uint64_t> keys{ {mangling, key} };
+    std::vector<GenericAstNode *> toVisit{ getRealRoot() };
+    while (!toVisit.empty())
+    {
+        auto candidate = toVisit.back();
+        toVisit.pop_back();
+        if (getKey(candidate, mangling, key))
+        {
+            keys[mangling] = key;
+        }
+        for (auto &child : candidate->myChidren)
+        {
+            toVisit.push_back(child.get());
+        }
+    }
+    myCodeGenCache.startCompilation(mySourceCode, myLastArgs, optimization, std::move(keys));
+    return true;
+}
+
+bool AstReader::compilingCode()
+{
+    return myCodeGenCache.compiling();
+}
+
+bool AstReader::finishCodeCompilation(std::string &error)
+{
+    return myCodeGenCache.finishCompilation(error);
+}
+
+bool AstReader::startOptimizationRemarks(std::string const &optimization)
+{
+    if (myOptimizationRemarks.valid())
+    {
+        return false;
+    }
+    myRemarksTreeVersion = myTreeVersion;
+    myRemarksOptimization = optimization;
+    auto sourceCode = mySourceCode;
+    auto args = myLastArgs;
+    myOptimizationRemarks = std::async(std::launch::async, [sourceCode, args, optimization]()
+    {
+        std::pair<std::vector<OptimizationRemark>, std::string> result;
+        collectOptimizationRemarks(sourceCode, args, optimization, result.first, result.second);
+        return result;
+    });
+    return true;
+}
+
+bool AstReader::computingOptimizationRemarks()
+{
+    return myOptimizationRemarks.valid();
+}
+
+bool AstReader::optimizationRemarksComputed()
+{
+    return myOptimizationRemarks.valid() && myOptimizationRemarks.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+bool AstReader::takeOptimizationRemarks(AnalysisReport &result, std::string &error)
+{
+    if (!myOptimizationRemarks.valid())
+    {
+        error = "No optimization remarks are being collected";
+        return false;
+    }
+    auto remarks = myOptimizationRemarks.get();
+    if (!remarks.second.empty())
+    {
+        error = remarks.second;
+        return false;
+    }
+    if (myRemarksTreeVersion != myTreeVersion || !isReady)
+    {
+        error = "The AST changed while the optimization remarks were collected";
+        return false;
+    }
+    for (auto node : myBadgedNodes)
+    {
+        node->badge.clear();
+    }
+    myBadgedNodes.clear();
+
+    result.title = "Optimization remarks at " + myRemarksOptimization;
+    result.headers = { "Kind", "Pass", "Message", "Node", "Position" };
+    struct NodeRemarks
+    {
+        unsigned counts[3];
+        std::string text;
+    };
+    std::map<GenericAstNode *, NodeRemarks> byNode;
+    for (auto &remark : remarks.first)
+    {
+        GenericAstNode *node = nullptr;
+        if (remark.offset >= 0 && getRealRoot() != nullptr && !getRealRoot()->myChidren.empty())
+        {
+            node = getBestNodeMatchingPosition(remark.offset).back();
+            auto &nodeRemarks = byNode[node];
+            ++nodeRemarks.counts[remark.kind];
+            nodeRemarks.text += (nodeRemarks.text.empty() ? "" : "\n") + std::string(getRemarkKindName(remark.kind)) + " " + remark.pass + ": " + remark.message;
+        }
+        result.rows.push_back(AnalysisReport::Row{ node, { getRemarkKindName(remark.kind), remark.pass, remark.message,
+            node != nullptr ? node->name : "", remark.position } });
+    }
+    for (auto &nodeRemarks : byNode)
+    {
+        auto node = nodeRemarks.first;
+        for (auto kind : { OptimizationRemark::Missed, OptimizationRemark::Passed, OptimizationRemark::Analysis })
+        {
+            if (nodeRemarks.second.counts[kind] != 0)
+            {
+                node->badge += (node->badge.empty() ? "" : ", ") + std::to_string(nodeRemarks.second.counts[kind]) + " " + getRemarkKindName(kind);
+            }
+        }
+        node->setProperty("Optimization remarks at " + myRemarksOptimization, nodeRemarks.second.text);
+        myBadgedNodes.push_back(node);
+    }
+    // Missed optimizations are the ones worth looking at
+    std::stable_sort(result.rows.begin(), result.rows.end(), [](AnalysisReport::Row const &r1, AnalysisReport::Row const &r2)
+    {
+        return (r1.cells[0] == "missed") > (r2.cells[0] == "missed");
+    });
+    return true;
+}
+
+bool AstReader::annotateLoopDepths(GenericAstNode *node)
+{
+    if (!ready() || isDetached())
+    {
+        return false;
+    }
+    if (myLoopDepths == nullptr)
+    {
+        myLoopDepths = std::make_unique<LoopDepthFinder>(getContext());
+    }
+    unsigned const hotDepth = 2;
+    return myLoopDepths->annotateFunction(node, hotDepth);
+}
+
+void AstReader::discardFunctionWeights()
+{
+    if (myFunctionWeights.valid())
+    {
+        myFunctionWeights.wait();
+        myFunctionWeights = {};
+    }
+}
+
 bool AstReader::ready()
 {
-    return isReady;
+    return isReady && !myFunctionWeights.valid();
 }
 
 void AstReader::dirty()
@@ -538,3 +1449,273 @@ void AstReader::dirty()
     isReady = false;
 }
 
+bool AstReader::getRangeInMainFile(GenericAstNode *node, std::pair<int, int> &result)
+{
+    if (isDetached())
+    {
+        return node->getDetachedRangeInMainFile(result);
+    }
+    return node->getRangeInMainFile(result, getManager(), getContext());
+}
+
+void AstReader::setDetachedMode(bool detached, bool precomputeCfg)
+{
+    myDetachedMode = detached;
+    myPrecomputeCfgWhenDetached = precomputeCfg;
+}
+
+bool AstReader::isDetached()
+{
+    return myAst == nullptr;
+}
+
+void AstReader::detachTree()
+{
+    auto &manager = myAst->getSourceManager();
+    auto &context = myAst->getASTContext();
+    std::vector<GenericAstNode *> toVisit{ myArtificialRoot.get() };
+    for (auto &sharedRoot : mySharedTypeNodes.roots)
+    {
+        toVisit.push_back(sharedRoot.get());
+    }
+    while (!toVisit.empty())
+    {
+        auto node = toVisit.back();
+        toVisit.pop_back();
+        node->detach(manager, context, myPrecomputeCfgWhenDetached);
+        for (auto &child : node->myChidren)
+        {
+            toVisit.push_back(child.get());
+        }
+    }
+    myLoopDepths.reset();
+    myAst.reset();
+}
+
+bool AstReader::saveSnapshot(std::string const &fileName)
+{
+    if (myArtificialRoot == nullptr)
+    {
+        return false;
+    }
+    return saveAstSnapshot(fileName, myArtificialRoot.get(), mySharedTypeNodes.roots, mySourceCode, [this](GenericAstNode *node, std::pair<int, int> &range)
+    {
+        return getRangeInMainFile(node, range);
+    });
+}
+
+GenericAstNode *AstReader::loadSnapshot(std::string const &fileName)
+{
+    std::string sourceCode;
+    SharedTypeNodes sharedTypeNodes;
+    auto root = loadAstSnapshot(fileName, sourceCode, sharedTypeNodes.roots);
+    if (root == nullptr || root->myChidren.empty())
+    {
+        return nullptr;
+    }
+    discardFunctionWeights();
+    ++myTreeVersion;
+    myBadgedNodes.clear();
+    myLoopDepths.reset();
+    myAst.reset();
+    myNodesByAstNode.clear();
+    myIncludeProfiler = IncludeProfiler{};
+    myMacroProfiler = MacroProfiler{};
+    myLastArgs.clear();
+    mySourceCode = std::move(sourceCode);
+    myArtificialRoot = std::move(root);
+    mySharedTypeNodes = std::move(sharedTypeNodes); // The index is not needed anymore, since no new type will be added
+    isReady = true;
+    return myArtificialRoot.get();
+}
+
+std::string const &AstReader::getSourceCode()
+{
+    return mySourceCode;
+}
+
+SharedTypeNodes const &AstReader::getSharedTypeNodes()
+{
+    return mySharedTypeNodes;
+}
+
+void AstReader::setCollapseInstantiations(bool collapse)
+{
+    myCollapseInstantiations = collapse;
+}
+
+AnalysisReport AstReader::getTemplateBloatReport()
+{
+    AnalysisReport report;
+    report.title = "Template instantiations";
+    report.headers = { "Template", "Instantiations", "Nodes", "Nodes per instantiation" };
+    std::vector<TemplateBloat const *> sorted;
+    for (auto &bloat : myInstantiationStats.byTemplate)
+    {
+        sorted.push_back(&bloat.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](TemplateBloat const *b1, TemplateBloat const *b2) {return b1->nodes > b2->nodes; });
+    for (auto bloat : sorted)
+    {
+        report.rows.push_back(AnalysisReport::Row{ bloat->templateNode, {
+            bloat->templateName,
+            std::to_string(bloat->instantiations),
+            std::to_string(bloat->nodes),
+            std::to_string(bloat->nodes / bloat->instantiations) } });
+    }
+    return report;
+}
+
+namespace
+{
+size_t const maxQueryMatches = 10000; // More would not be usable anyway, and filling the view would take a long time
+}
+
+bool AstReader::runMatcherQuery(std::string const &query, AnalysisReport &result, std::string &error)
+{
+    std::vector<clang::ast_type_traits::DynTypedNode> matches;
+    bool truncated = false;
+    if (!findMatches(query, getContext(), maxQueryMatches, matches, truncated, error))
+    {
+        return false;
+    }
+    result.title = truncated ? "Query (only the first " + std::to_string(maxQueryMatches) + " matches)" : "Query";
+    result.headers = { "Node", "Kind", "Position" };
+    auto &manager = getManager();
+    for (auto &match : matches)
+    {
+        auto node = findNode(match);
+        std::string position;
+        auto location = manager.getPresumedLoc(manager.getExpansionLoc(match.getSourceRange().getBegin()));
+        if (location.isValid())
+        {
+            position = std::to_string(location.getLine()) + ":" + std::to_string(location.getColumn());
+            if (manager.getFileID(manager.getExpansionLoc(match.getSourceRange().getBegin())) != manager.getMainFileID())
+            {
+                position = std::string(location.getFilename()) + ":" + position;
+            }
+        }
+        result.rows.push_back(AnalysisReport::Row{ node, { node != nullptr ? node->name : "", match.getNodeKind().asStringRef().str(), position } });
+    }
+    return true;
+}
+
+GenericAstNode *AstReader::findNode(clang::ast_type_traits::DynTypedNode const &astNode)
+{
+    // Expanded collapsed nodes and proxies add nodes to the tree
+    if (myNodesByAstNode.empty() || myIndexedExpansions != GenericAstNode::getExpansionCount())
+    {
+        myNodesByAstNode.clear();
+        myIndexedExpansions = GenericAstNode::getExpansionCount();
+        // Breadth first, so that the first occurrence of a node is the one closest to the root
+        std::vector<GenericAstNode *> toVisit{ myArtificialRoot.get() };
+        for (size_t i = 0; i < toVisit.size(); ++i)
+        {
+            auto node = toVisit[i];
+            void const *key = nullptr;
+            if (auto decl = boost::get<clang::Decl *>(&node->myAstNode))
+            {
+                key = *decl;
+            }
+            else if (auto stmt = boost::get<clang::Stmt *>(&node->myAstNode))
+            {
+                key = *stmt;
+            }
+            if (key != nullptr)
+            {
+                myNodesByAstNode.emplace(key, node);
+            }
+            for (auto &child : node->myChidren)
+            {
+                toVisit.push_back(child.get());
+            }
+        }
+    }
+    // Nodes that are not in the tree (types, collapsed instantiations...) are represented by their closest ancestor that is
+    auto current = astNode;
+    while (true)
+    {
+        void const *key = current.get<clang::Decl>() != nullptr ?
+            static_cast<void const *>(current.get<clang::Decl>()) :
+            static_cast<void const *>(current.get<clang::Stmt>());
+        if (key != nullptr)
+        {
+            auto it = myNodesByAstNode.find(key);
+            if (it != myNodesByAstNode.end())
+            {
+                return it->second;
+            }
+        }
+        auto parents = getContext().getParents(current);
+        if (parents.empty())
+        {
+            return nullptr;
+        }
+        current = parents[0];
+    }
+}
+
+bool AstReader::openXRefIndex(std::string const &fileName)
+{
+    return myXRefIndex.open(fileName);
+}
+
+bool AstReader::findReferences(GenericAstNode *node, bool definitionsOnly, AnalysisReport &result, std::string &error)
+{
+    clang::Decl const *decl = nullptr;
+    if (auto nodeDecl = boost::get<clang::Decl *>(&node->myAstNode))
+    {
+        decl = *nodeDecl;
+    }
+    else if (auto stmt = boost::get<clang::Stmt *>(&node->myAstNode))
+    {
+        if (auto ref = dyn_cast_or_null<DeclRefExpr>(*stmt))
+        {
+            decl = ref->getDecl();
+        }
+        else if (auto member = dyn_cast_or_null<MemberExpr>(*stmt))
+        {
+            decl = member->getMemberDecl();
+        }
+        else if (auto construct = dyn_cast_or_null<CXXConstructExpr>(*stmt))
+        {
+            decl = construct->getConstructor();
+        }
+    }
+    std::string usr;
+    if (decl == nullptr || !getUsr(decl, usr))
+    {
+        error = "The node does not declare or reference a symbol that can be looked up";
+        return false;
+    }
+
+    // The current translation unit first, then the rest of the project
+    auto occurrences = myXRefs.find(usr);
+    auto indexed = myXRefIndex.find(usr);
+    occurrences.insert(occurrences.end(), indexed.begin(), indexed.end());
+    auto mainFile = getManager().getFileEntryForID(getManager().getMainFileID());
+    std::string mainFileName = mainFile != nullptr ? mainFile->getName() : "";
+    result.title = (definitionsOnly ? "Definitions of " : "References to ") + usr;
+    result.headers = { "File", "Line", "Column", "Kind" };
+    std::set<std::tuple<std::string, uint32_t, uint32_t>> seen; // Headers can be both in the current translation unit and in the index
+    for (auto &occurrence : occurrences)
+    {
+        if ((definitionsOnly && occurrence.kind != XRefOccurrence::Definition) ||
+            !seen.emplace(occurrence.file, occurrence.offset, occurrence.kind).second)
+        {
+            continue;
+        }
+        GenericAstNode *occurrenceNode = nullptr;
+        if (occurrence.file == mainFileName)
+        {
+            auto path = getBestNodeMatchingPosition(occurrence.offset);
+            occurrenceNode = path.empty() ? nullptr : path.back();
+        }
+        result.rows.push_back(AnalysisReport::Row{ occurrenceNode, {
+            occurrence.file,
+            std::to_string(occurrence.line),
+            std::to_string(occurrence.column),
+            occurrence.kind == XRefOccurrence::Definition ? "Definition" : occurrence.kind == XRefOccurrence::Declaration ? "Declaration" : "Reference" } });
+    }
+    return true;
+}
@@ -7,11 +7,29 @@
 #include "clang/Tooling/Tooling.h"
 #include "llvm/Support/CommandLine.h"
 #include "clang/basic/SourceLocation.h"
+#include "clang/AST/ASTTypeTraits.h"
+#include "clang/Analysis/CFG.h"
 #pragma warning(pop)
 #include <string>
+#include <cstdint>
+#include <unordered_map>
+#include <future>
+#include <atomic>
 #include <boost/variant.hpp>
+#include "AnalysisReport.h"
+#include "ParseCache.h"
+#include "ModuleCache.h"
+#include "CrossReferences.h"
+#include "IncludeProfiler.h"
+#include "MacroProfiler.h"
+#include "FunctionWeights.h"
+#include "CodeGenCache.h"
+#include "OptimizationRemarks.h"
+#include "CfgLoops.h"
 
 
+clang::CFG::BuildOptions getCFGBuildOptions(); // Used for all the control flow graphs built by the viewer
+
 class GenericAstNode
 {
 public:
@@ -19,13 +37,19 @@ public:
     int findChildIndex(GenericAstNode *node); // Return -1 if not found
     void attach(std::unique_ptr<GenericAstNode> child);
     std::string name;
+    std::string kind; // Class of the node (FunctionDecl, CallExpr...), name may have more after it
     std::vector<std::unique_ptr<GenericAstNode>> myChidren;
     bool getRangeInMainFile(std::pair<int, int> &result, clang::SourceManager const &manager, clang::ASTContext &context); // Return false if the range is not fully in the main file
     clang::SourceRange getRange();
     int getColor(); // Will return a color identifier How this is linked to the real color is up to the user
+    void detach(clang::SourceManager const &manager, clang::ASTContext &context, bool computeDetails); // Precomputes everything the viewer needs, after that, myAstNode is no longer used
+    bool isDetached() const;
+    bool getDetachedRangeInMainFile(std::pair<int, int> &result) const; // Return false if the node is not detached, or not in the main file
+    void restoreDetached(bool isInMainFile, std::pair<int, int> const &range, int color); // Used to rebuild a detached node without clang (see AstSnapshot)
     using Properties = std::map<std::string, std::string>;
     void setProperty(std::string const &propertyName, std::string const &value);
     Properties const &getProperties() const;
+    void setLazyProperties(std::function<void(Properties &)> const &computer); // For properties that are only worth computing when displayed
     boost::variant<clang::Decl *, clang::Stmt *> myAstNode;
     GenericAstNode *myParent;
 
@@ -34,8 +58,54 @@ public:
     std::string details;
     std::function<std::string()> detailsComputer;
 
+    std::string badge; // Short annotation displayed after the name in the tree (optimization remarks...)
+    bool isHighlighted; // Displayed with a highlighted background (statements deep in loops...)
+
+    uint64_t myStructuralHash; // Only meaningful after a call to computeStructuralHashes (see AstDiff.h)
+
+    // Subtrees of types are shared between all the places where the type is used. In that case, the node
+    // has no children of its own until they are created as proxies for the children of mySharedNode,
+    // so that each use of the type has its own parent links.
+    GenericAstNode *mySharedNode;
+    // Collapsed nodes (template instantiations) only create their children when they are first needed
+    std::function<std::vector<std::unique_ptr<GenericAstNode>>()> childrenComputer;
+    bool canExpand() const; // True if the children of this node have not been created yet
+    std::vector<std::unique_ptr<GenericAstNode>> createChildren(); // The children still have to be attached
+    void expand();
+    void expandInstantiations(); // Expand all the collapsed nodes of the subtree, so that walking myChidren reaches everything
+    static unsigned getExpansionCount(); // Of all the trees, so that the indexes of the nodes can tell they are outdated
+
 private:
-    Properties myProperties;
+    static std::atomic<unsigned> ourExpansionCount;
+    mutable Properties myProperties;
+    mutable std::function<void(Properties &)> myLazyProperties;
+    bool myIsDetached;
+    bool myIsInMainFile; // Only meaningful once detached
+    std::pair<int, int> myRangeInMainFile; // Only meaningful once detached
+    int myColor; // Only meaningful once detached
+};
+
+// Clang types are uniqued, so the subtree of a type is built only once, and referenced by all its uses
+struct SharedTypeNodes
+{
+    std::unordered_map<void *, GenericAstNode *> index; // By opaque pointer of the QualType
+    std::vector<std::unique_ptr<GenericAstNode>> roots;
+};
+
+struct TemplateBloat
+{
+    std::string templateName;
+    GenericAstNode *templateNode; // nullptr if the template itself is not in the tree
+    unsigned instantiations;
+    unsigned nodes; // Total, for all instantiations
+};
+
+// Cost of template instantiations, computed without building their subtrees
+struct InstantiationStats
+{
+    std::unordered_map<clang::Decl const *, unsigned> nodeCounts; // By instantiation
+    std::unordered_map<clang::Decl const *, TemplateBloat> byTemplate;
+    std::unordered_map<clang::Decl const *, GenericAstNode *> templateNodes;
 };
 
 class AstReader
@@ -49,12 +119,100 @@ public:
     std::vector<GenericAstNode *> getBestNodeMatchingPosition(int position); // Return the path from root to the node
     bool ready();
     void dirty(); // Ready will be false until the reader is run again
+    bool getRangeInMainFile(GenericAstNode *node, std::pair<int, int> &result); // Works both on live and detached trees
+    // In detached mode, the ASTUnit is released as soon as the tree is built. Functions that require
+    // clang (getManager, getContext, details computation...) are no longer available after that.
+    void setDetachedMode(bool detached, bool precomputeCfg);
+    bool isDetached();
+    bool saveSnapshot(std::string const &fileName);
+    GenericAstNode *loadSnapshot(std::string const &fileName); // Return nullptr on failure. On success, the reader is in detached state
+    std::string const &getSourceCode();
+    SharedTypeNodes const &getSharedTypeNodes();
+    void setCollapseInstantiations(bool collapse); // Not used in detached mode, since collapsed nodes need clang to be expanded
+    AnalysisReport getTemplateBloatReport();
+    void invalidateParseCache(); // Needed when files are added or removed in the include paths
+    unsigned getSavedStatCount(); // During the last call to readAst
+    void setUseModules(bool useModules);
+    void setModuleCacheLocation(std::string const &directory, uint64_t sizeLimit); // The cache is pruned after each parse to stay under the limit
+    uint64_t getModuleCacheSizeLimit();
+    std::string const &getModuleCacheDirectory();
+    std::string const &getParseError(); // Why the last call to readAst did not produce an AST, empty if it did
+    void copySettings(AstReader const &other); // Everything that changes the tree built from the same code and command line
+    std::string const &getCommandLineError(); // Found by the last call to readAst in the response files, empty if none
+    bool hitModuleCache(); // True if the last call to readAst did not need to compile any module
+    std::vector<ModuleUse> const &getLastParseModules(); // Used by the last call to readAst
+    bool runMatcherQuery(std::string const &query, AnalysisReport &result, std::string &error); // See MatcherQuery.h. Requires a live AST
+    bool openXRefIndex(std::string const &fileName); // Index of the whole project, see buildXRefIndex
+    // Occurrences of the symbol declared or referenced by node, in the current translation unit and in the index. Requires a live AST
+    bool findReferences(GenericAstNode *node, bool definitionsOnly, AnalysisReport &result, std::string &error);
+    void setProfileIncludes(bool profile);
+    IncludeProfileNode const *getIncludeProfile(); // nullptr if the last parse was not profiled
+    void setProfileMacros(bool profile);
+    std::vector<MacroProfileEntry> const *getMacroProfile(); // Sorted by expanded tokens, nullptr if the last parse was not profiled
+    // The weights are computed in a background thread. Until they are taken, the reader is not ready, so that
+    // nothing else uses clang meanwhile. Requires a live AST
+    bool startFunctionWeights();
+    bool computingFunctionWeights(); // True until the weights are taken
+    bool functionWeightsComputed(); // The weights can be taken without waiting
+    AnalysisReport takeFunctionWeightsReport(); // Sorted by node count
+    void setCacheLineSize(unsigned size); // In bytes, used by the record layouts of the next parses and by the padding report
+    AnalysisReport getRecordPaddingReport(); // Records of the translation unit, worst padded first. Requires a live AST
+    AnalysisReport getHiddenCopiesReport(uint64_t minSize); // See HiddenCopies.h, biggest types first. Requires a live AST
+    AnalysisReport getMoveAuditReport(); // See MoveAudit.h, types stored in standard containers first. Requires a live AST
+    AnalysisReport getAllocationSitesReport(); // See AllocationSites.h, deepest in loops first. Requires a live AST
+    AnalysisReport getVirtualCallsReport(); // See VirtualCalls.h, grouped by callee. Requires a live AST
+    // Optimized code of a function definition, see CodeGenCache.h. If it is not cached yet, result is nullptr and
+    // the translation unit is compiled in the background, the function has to be asked again once it is done. Requires a live AST
+    bool getFunctionCode(GenericAstNode *node, std::string const &optimization, std::shared_ptr<FunctionCode const> &result, std::string &error);
+    bool compilingCode();
+    bool finishCodeCompilation(std::string &error); // Return false if the compilation is still running
+    // The translation unit is compiled in a background thread, see OptimizationRemarks.h. The remarks are then
+    // attached to the innermost nodes containing them, as badges and properties. Works on detached trees too
+    bool startOptimizationRemarks(std::string const &optimization); // Return false if remarks are already being collected
+    bool computingOptimizationRemarks(); // True until the remarks are taken
+    bool optimizationRemarksComputed(); // The remarks can be taken without waiting
+    bool takeOptimizationRemarks(AnalysisReport &result, std::string &error); // Fails if the compilation failed, or if the tree changed meanwhile
+    // Loop depths of the statements of the function containing node, and highlight of the calls and allocations at
+    // depth 2 or more, see LoopDepthFinder::annotateFunction. Computed once per function. Requires a live AST
+    bool annotateLoopDepths(GenericAstNode *node);
 private:
+    void detachTree();
+    void discardFunctionWeights(); // Waits for the background thread, that uses the AST
+    GenericAstNode *findNode(clang::ast_type_traits::DynTypedNode const &astNode);
     GenericAstNode *findPosInChildren(std::vector<std::unique_ptr<GenericAstNode>> const &candidates, int position);
-    std::string args;
+    std::string myCachedOptions;
+    std::vector<std::string> myCachedArgs; // Result of splitting myCachedOptions
+    std::vector<std::string> myLastArgs; // Used for the last parse, including the module arguments
+    bool myCachedArgsUseResponseFiles;
+    std::string myCommandLineError; // Found when splitting myCachedOptions
+    std::string myParseError;
+    ParseCache myParseCache;
+    ModuleCache myModuleCache;
+    std::unordered_map<void const *, GenericAstNode *> myNodesByAstNode; // Built on the first query
+    unsigned myIndexedExpansions; // GenericAstNode::getExpansionCount() when myNodesByAstNode was built
+    XRefTable myXRefs; // Of the current translation unit, recorded at each parse
+    XRefIndex myXRefIndex;
+    bool myProfileIncludes;
+    IncludeProfiler myIncludeProfiler;
+    bool myProfileMacros;
+    MacroProfiler myMacroProfiler;
+    unsigned myCacheLineSize;
+    CodeGenCache myCodeGenCache; // Kept between parses, the keys depend on the source of the functions
     std::string mySourceCode; // Needs to stay alive while we navigate the tree
     std::unique_ptr<clang::ASTUnit> myAst;
+    std::unique_ptr<LoopDepthFinder> myLoopDepths; // Keeps the control flow graphs of the annotated functions, released before myAst
     std::unique_ptr<GenericAstNode> myArtificialRoot; // We need an artificial root on top of the real root, because the root is not displayed by Qt
+    SharedTypeNodes mySharedTypeNodes;
+    bool myCollapseInstantiations;
+    InstantiationStats myInstantiationStats;
     bool isReady;
+    bool myDetachedMode;
+    bool myPrecomputeCfgWhenDetached;
+    unsigned myTreeVersion; // Incremented each time a new tree is built
+    unsigned myRemarksTreeVersion; // Tree the remarks being collected will be attached to
+    std::string myRemarksOptimization;
+    std::future<std::pair<std::vector<OptimizationRemark>, std::string>> myOptimizationRemarks; // With the error, if any
+    std::vector<GenericAstNode *> myBadgedNodes; // Of the current tree
+    std::future<std::vector<FunctionWeight>> myFunctionWeights; // Last member, so that the background thread ends before the AST is destroyed
 };
 
@@ -0,0 +1,351 @@
+#include "AstSnapshot.h"
+#include <cstring>
+#include <cstdint>
+#include <unordered_map>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/FileSystem.h>
+#pragma warning (pop)
+
+namespace
+{
+
+char const snapshotMagic[8] = { 'C', 'A', 'S', 'T', 'S', 'N', 'A', 'P' };
+uint32_t const snapshotVersion = 4;
+uint32_t const byteOrderMark = 0x01020304; // Reads differently on a machine with another byte order
+uint32_t const noIndex = 0xFFFFFFFF;
+
+enum NodeFlags : uint32_t
+{
+    InMainFile = 1 << 0,
+    HasDetails = 1 << 1,
+    ColorShift = 8
+};
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t sharedRootCount; // Shared roots are stored just after the main tree, which is therefore made of the first treeNodeCount nodes
+    uint32_t treeNodeCount;
+    uint32_t propertyCount;
+    uint32_t stringCount;
+    uint32_t stringDataSize;
+    uint32_t sourceCode; // Index in the string table
+};
+
+struct NodeRecord
+{
+    uint32_t parent;
+    uint32_t firstChild;
+    uint32_t childCount;
+    uint32_t name;
+    uint32_t kind;
+    uint32_t firstProperty;
+    uint32_t propertyCount;
+    int32_t rangeStart;
+    int32_t rangeEnd;
+    uint32_t flags;
+    uint32_t detailsTitle;
+    uint32_t details;
+    uint32_t sharedNode;
+};
+
+struct PropertyRecord
+{
+    uint32_t name;
+    uint32_t value;
+};
+
+class StringTable
+{
+public:
+    uint32_t add(std::string const &s)
+    {
+        auto it = myIndices.find(s);
+        if (it != myIndices.end())
+        {
+            return it->second;
+        }
+        auto index = static_cast<uint32_t>(myOffsets.size());
+        myOffsets.push_back(static_cast<uint32_t>(myData.size()));
+        myData += s;
+        myIndices.emplace(s, index);
+        return index;
+    }
+    std::vector<uint32_t> offsets() const // One more than the number of strings, the last one marks the end of the data
+    {
+        auto result = myOffsets;
+        result.push_back(static_cast<uint32_t>(myData.size()));
+        return result;
+    }
+    std::string const &data() const
+    {
+        return myData;
+    }
+private:
+    std::unordered_map<std::string, uint32_t> myIndices;
+    std::vector<uint32_t> myOffsets;
+    std::string myData;
+};
+
+template<class T>
+void writeArray(llvm::raw_ostream &os, std::vector<T> const &data)
+{
+    if (!data.empty())
+    {
+        os.write(reinterpret_cast<char const *>(data.data()), data.size() * sizeof(T));
+    }
+}
+
+} // namespace
+
+
+bool saveAstSnapshot(std::string const &fileName, GenericAstNode *artificialRoot, std::vector<std::unique_ptr<GenericAstNode>> const &sharedRoots,
+    std::string const &sourceCode, SnapshotRangeGetter const &getRange)
+{
+    StringTable strings;
+    std::vector<NodeRecord> nodes;
+    std::vector<PropertyRecord> properties;
+
+    // Breadth first numbering, so that the children of a node are stored contiguously
+    std::vector<GenericAstNode *> order{ artificialRoot };
+    std::vector<uint32_t> parents{ noIndex };
+    size_t treeNodeCount = 0;
+    std::unordered_map<GenericAstNode *, uint32_t> sharedIndices; // Only shared nodes can be referenced, no need to index the main tree
+    // Children of the collapsed nodes, built apart since the tree may be displayed, and must not change behind its model
+    std::vector<std::unique_ptr<GenericAstNode>> materialized;
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        auto node = order[i];
+        if (treeNodeCount != 0 && i >= treeNodeCount)
+        {
+            sharedIndices[node] = static_cast<uint32_t>(i);
+        }
+        NodeRecord record;
+        record.parent = parents[i];
+        record.firstChild = static_cast<uint32_t>(order.size());
+        auto firstMaterialized = materialized.size();
+        if (node->myChidren.empty() && node->childrenComputer != nullptr)
+        {
+            for (auto &child : node->childrenComputer())
+            {
+                materialized.push_back(std::move(child));
+            }
+        }
+        record.childCount = static_cast<uint32_t>(node->myChidren.size() + materialized.size() - firstMaterialized);
+        for (auto &child : node->myChidren)
+        {
+            order.push_back(child.get());
+            parents.push_back(static_cast<uint32_t>(i));
+        }
+        for (auto child = firstMaterialized; child != materialized.size(); ++child)
+        {
+            order.push_back(materialized[child].get());
+            parents.push_back(static_cast<uint32_t>(i));
+        }
+        record.name = strings.add(node->name);
+        record.kind = strings.add(node->kind);
+        record.firstProperty = static_cast<uint32_t>(properties.size());
+        for (auto &prop : node->getProperties())
+        {
+            properties.push_back(PropertyRecord{ strings.add(prop.first), strings.add(prop.second) });
+        }
+        record.propertyCount = static_cast<uint32_t>(properties.size()) - record.firstProperty;
+
+        std::pair<int, int> range(0, 0);
+        bool isInMainFile = getRange(node, range);
+        record.rangeStart = range.first;
+        record.rangeEnd = range.second;
+        record.flags = (isInMainFile ? InMainFile : 0) | (static_cast<uint32_t>(node->getColor()) << ColorShift);
+
+        // Same policy as the detached mode: details are only kept for what is in the main file
+        if (node->hasDetails && isInMainFile && node->details.empty() && node->detailsComputer)
+        {
+            node->details = node->detailsComputer();
+        }
+        record.detailsTitle = noIndex;
+        record.details = noIndex;
+        if (node->hasDetails && !node->details.empty())
+        {
+            record.flags |= HasDetails;
+            record.detailsTitle = strings.add(node->detailsTitle);
+            record.details = strings.add(node->details);
+        }
+        record.sharedNode = noIndex;
+        nodes.push_back(record);
+
+        if (i + 1 == order.size() && treeNodeCount == 0)
+        {
+            // We are done with the main tree, the shared roots come next
+            treeNodeCount = order.size();
+            for (auto &sharedRoot : sharedRoots)
+            {
+                order.push_back(sharedRoot.get());
+                parents.push_back(noIndex);
+            }
+        }
+    }
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        if (order[i]->mySharedNode != nullptr)
+        {
+            auto it = sharedIndices.find(order[i]->mySharedNode);
+            if (it != sharedIndices.end())
+            {
+                nodes[i].sharedNode = it->second;
+            }
+        }
+    }
+
+    SnapshotHeader header;
+    std::memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+    header.byteOrder = byteOrderMark;
+    header.version = snapshotVersion;
+    header.nodeCount = static_cast<uint32_t>(nodes.size());
+    header.sharedRootCount = static_cast<uint32_t>(sharedRoots.size());
+    header.treeNodeCount = static_cast<uint32_t>(treeNodeCount);
+    header.propertyCount = static_cast<uint32_t>(properties.size());
+    header.sourceCode = strings.add(sourceCode);
+    auto offsets = strings.offsets();
+    header.stringCount = static_cast<uint32_t>(offsets.size() - 1);
+    header.stringDataSize = static_cast<uint32_t>(strings.data().size());
+
+    std::error_code error;
+    llvm::raw_fd_ostream os(fileName, error, llvm::sys::fs::F_None);
+    if (error)
+    {
+        return false;
+    }
+    os.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    writeArray(os, nodes);
+    writeArray(os, properties);
+    writeArray(os, offsets);
+    os << strings.data();
+    os.close();
+    return !os.has_error();
+}
+
+
+std::unique_ptr<GenericAstNode> loadAstSnapshot(std::string const &fileName, std::string &sourceCode, std::vector<std::unique_ptr<GenericAstNode>> &sharedRoots)
+{
+    // No null terminator required, so that large files get memory mapped instead of copied
+    auto buffer = llvm::MemoryBuffer::getFile(fileName, -1, false);
+    if (!buffer)
+    {
+        return nullptr;
+    }
+    auto data = (*buffer)->getBufferStart();
+    auto size = (*buffer)->getBufferSize();
+    if (size < sizeof(SnapshotHeader))
+    {
+        return nullptr;
+    }
+    auto header = reinterpret_cast<SnapshotHeader const *>(data);
+    if (std::memcmp(header->magic, snapshotMagic, sizeof(snapshotMagic)) != 0 || header->byteOrder != byteOrderMark ||
+        header->version != snapshotVersion || header->nodeCount == 0 ||
+        header->treeNodeCount == 0 || uint64_t(header->treeNodeCount) + header->sharedRootCount > header->nodeCount)
+    {
+        return nullptr;
+    }
+    auto expectedSize = sizeof(SnapshotHeader) +
+        uint64_t(header->nodeCount) * sizeof(NodeRecord) +
+        uint64_t(header->propertyCount) * sizeof(PropertyRecord) +
+        (uint64_t(header->stringCount) + 1) * sizeof(uint32_t) +
+        header->stringDataSize;
+    if (size != expectedSize)
+    {
+        return nullptr;
+    }
+    auto nodes = reinterpret_cast<NodeRecord const *>(data + sizeof(SnapshotHeader));
+    auto properties = reinterpret_cast<PropertyRecord const *>(nodes + header->nodeCount);
+    auto offsets = reinterpret_cast<uint32_t const *>(properties + header->propertyCount);
+    auto stringData = reinterpret_cast<char const *>(offsets + header->stringCount + 1);
+
+    bool isValid = true;
+    auto getString = [&](uint32_t index)
+    {
+        if (index >= header->stringCount || offsets[index] > offsets[index + 1] || offsets[index + 1] > header->stringDataSize)
+        {
+            isValid = false;
+            return std::string();
+        }
+        return std::string(stringData + offsets[index], stringData + offsets[index + 1]);
+    };
+
+    std::vector<GenericAstNode *> created(header->nodeCount, nullptr);
+    auto root = std::make_unique<GenericAstNode>();
+    created[0] = root.get();
+    std::vector<std::unique_ptr<GenericAstNode>> loadedSharedRoots;
+    for (auto i = header->treeNodeCount; i != header->treeNodeCount + header->sharedRootCount; ++i)
+    {
+        loadedSharedRoots.push_back(std::make_unique<GenericAstNode>());
+        created[i] = loadedSharedRoots.back().get();
+    }
+    for (uint32_t i = 0; i < header->nodeCount && isValid; ++i)
+    {
+        auto &record = nodes[i];
+        auto node = created[i];
+        if (node == nullptr || uint64_t(record.firstProperty) + record.propertyCount > header->propertyCount)
+        {
+            return nullptr;
+        }
+        node->name = getString(record.name);
+        node->kind = getString(record.kind);
+        for (auto p = record.firstProperty; p != record.firstProperty + record.propertyCount; ++p)
+        {
+            node->setProperty(getString(properties[p].name), getString(properties[p].value));
+        }
+        if (record.flags & HasDetails)
+        {
+            node->hasDetails = true;
+            node->detailsTitle = getString(record.detailsTitle);
+            node->details = getString(record.details);
+        }
+        node->restoreDetached((record.flags & InMainFile) != 0, std::make_pair(record.rangeStart, record.rangeEnd), record.flags >> ColorShift);
+
+        // Children always come after their parent, we create them now so that the next iterations can fill them
+        if (record.childCount != 0 && (record.firstChild <= i || uint64_t(record.firstChild) + record.childCount > header->nodeCount))
+        {
+            return nullptr;
+        }
+        for (auto c = record.firstChild; c != record.firstChild + record.childCount; ++c)
+        {
+            if (nodes[c].parent != i)
+            {
+                return nullptr;
+            }
+            auto child = std::make_unique<GenericAstNode>();
+            created[c] = child.get();
+            node->attach(std::move(child));
+        }
+    }
+    if (!isValid)
+    {
+        return nullptr;
+    }
+    for (uint32_t i = 0; i < header->nodeCount; ++i)
+    {
+        if (nodes[i].sharedNode != noIndex)
+        {
+            // Only nodes stored after the main tree can be shared
+            if (nodes[i].sharedNode >= header->nodeCount || nodes[i].sharedNode < header->treeNodeCount)
+            {
+                return nullptr;
+            }
+            created[i]->mySharedNode = created[nodes[i].sharedNode];
+        }
+    }
+    sourceCode = getString(header->sourceCode);
+    if (!isValid)
+    {
+        return nullptr;
+    }
+    sharedRoots = std::move(loadedSharedRoots);
+    return root;
+}
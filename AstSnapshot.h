@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <functional>
+#include "AstReader.h"
+
+// A snapshot is a compact binary image of a GenericAstNode tree, that can be reopened without clang.
+// Everything is stored as flat arrays of 32 bits integers (nodes in breadth first order, so that the
+// children of a node are contiguous, properties, string table) followed by the string data, including
+// the source code. Reading it does not require any parsing: the file is memory mapped, and the tree is
+// rebuilt in one pass over the records. The integers are stored in the byte order of the machine that
+// saved the file, only machines with the same byte order can read it.
+// Shared type subtrees (see SharedTypeNodes) are stored once, after the main tree, and referenced by index.
+// Collapsed subtrees (template instantiations) are materialized: A snapshot has no AST to expand them from
+// later, so it contains the same nodes as a parse without collapsing. The tree being saved is left as it is.
+
+using SnapshotRangeGetter = std::function<bool(GenericAstNode *, std::pair<int, int> &)>;
+
+bool saveAstSnapshot(std::string const &fileName, GenericAstNode *artificialRoot, std::vector<std::unique_ptr<GenericAstNode>> const &sharedRoots,
+    std::string const &sourceCode, SnapshotRangeGetter const &getRange);
+// Return nullptr if the file is not a valid snapshot
+std::unique_ptr<GenericAstNode> loadAstSnapshot(std::string const &fileName, std::string &sourceCode, std::vector<std::unique_ptr<GenericAstNode>> &sharedRoots);
@@ -0,0 +1,381 @@
+#include "CfgLoops.h"
+#include "AstReader.h"
+#include <algorithm>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/ExprCXX.h>
+#include <clang/AST/StmtCXX.h>
+#pragma warning (pop)
+
+using namespace clang;
+
+namespace
+{
+
+unsigned const undefinedIndex = static_cast<unsigned>(-1);
+
+using Graph = std::vector<std::vector<unsigned>>; // Successors, by block ID
+
+// Strongly connected components of the subgraph made of the blocks for which inSubgraph is true. Edges toward
+// headers of enclosing loops are ignored. Tarjan's algorithm, without recursion, since graphs can be huge.
+std::vector<std::vector<unsigned>> findComponents(Graph const &graph, std::vector<unsigned> const &blocks,
+    std::vector<bool> const &inSubgraph, std::vector<bool> const &isHeader)
+{
+    auto isEdge = [&](unsigned target) {return inSubgraph[target] && !isHeader[target]; };
+    std::vector<std::vector<unsigned>> components;
+    std::vector<unsigned> index(graph.size(), undefinedIndex);
+    std::vector<unsigned> lowLink(graph.size(), 0);
+    std::vector<bool> onStack(graph.size(), false);
+    std::vector<unsigned> stack;
+    std::vector<std::pair<unsigned, size_t>> calls; // Block, and next successor to visit
+    unsigned counter = 0;
+    for (auto root : blocks)
+    {
+        if (index[root] != undefinedIndex)
+        {
+            continue;
+        }
+        index[root] = lowLink[root] = counter++;
+        stack.push_back(root);
+        onStack[root] = true;
+        calls.emplace_back(root, 0);
+        while (!calls.empty())
+        {
+            auto block = calls.back().first;
+            auto next = calls.back().second;
+            if (next < graph[block].size())
+            {
+                ++calls.back().second;
+                auto successor = graph[block][next];
+                if (!isEdge(successor))
+                {
+                    continue;
+                }
+                if (index[successor] == undefinedIndex)
+                {
+                    index[successor] = lowLink[successor] = counter++;
+                    stack.push_back(successor);
+                    onStack[successor] = true;
+                    calls.emplace_back(successor, 0);
+                }
+                else if (onStack[successor])
+                {
+                    lowLink[block] = std::min(lowLink[block], index[successor]);
+                }
+                continue;
+            }
+            if (lowLink[block] == index[block])
+            {
+                components.emplace_back();
+                unsigned member;
+                do
+                {
+                    member = stack.back();
+                    stack.pop_back();
+                    onStack[member] = false;
+                    components.back().push_back(member);
+                } while (member != block);
+            }
+            calls.pop_back();
+            if (!calls.empty())
+            {
+                auto parent = calls.back().first;
+                lowLink[parent] = std::min(lowLink[parent], lowLink[block]);
+            }
+        }
+    }
+    return components;
+}
+
+Stmt const *getStmt(GenericAstNode const *node)
+{
+    auto stmt = boost::get<Stmt *>(&node->myAstNode);
+    return stmt != nullptr ? *stmt : nullptr;
+}
+
+bool isLoop(Stmt const *stmt)
+{
+    return isa<ForStmt>(stmt) || isa<WhileStmt>(stmt) || isa<DoStmt>(stmt) || isa<CXXForRangeStmt>(stmt);
+}
+
+} // namespace
+
+
+std::vector<unsigned> computeLoopDepths(CFG const &cfg)
+{
+    Graph successors(cfg.getNumBlockIDs());
+    Graph predecessors(cfg.getNumBlockIDs());
+    std::vector<unsigned> allBlocks;
+    for (auto block : cfg)
+    {
+        allBlocks.push_back(block->getBlockID());
+        for (auto &successor : block->succs())
+        {
+            if (auto reachable = successor.getReachableBlock())
+            {
+                successors[block->getBlockID()].push_back(reachable->getBlockID());
+                predecessors[reachable->getBlockID()].push_back(block->getBlockID());
+            }
+        }
+    }
+
+    std::vector<unsigned> depths(cfg.getNumBlockIDs(), 0);
+    std::vector<bool> isHeader(cfg.getNumBlockIDs(), false);
+    // Each cycle is a loop. Inside it, the loops it contains are the cycles that remain once the edges toward its
+    // headers are removed.
+    std::vector<std::vector<unsigned>> toSplit{ allBlocks };
+    while (!toSplit.empty())
+    {
+        auto blocks = std::move(toSplit.back());
+        toSplit.pop_back();
+        std::vector<bool> inSubgraph(cfg.getNumBlockIDs(), false);
+        for (auto block : blocks)
+        {
+            inSubgraph[block] = true;
+        }
+        for (auto &component : findComponents(successors, blocks, inSubgraph, isHeader))
+        {
+            auto block = component.front();
+            auto hasSelfEdge = std::find(successors[block].begin(), successors[block].end(), block) != successors[block].end() && !isHeader[block];
+            if (component.size() == 1 && !hasSelfEdge)
+            {
+                continue;
+            }
+            std::vector<bool> inComponent(cfg.getNumBlockIDs(), false);
+            for (auto member : component)
+            {
+                inComponent[member] = true;
+                ++depths[member];
+            }
+            bool foundHeader = false;
+            for (auto member : component)
+            {
+                auto &memberPredecessors = predecessors[member];
+                if (std::any_of(memberPredecessors.begin(), memberPredecessors.end(), [&](unsigned p) {return !inComponent[p]; }))
+                {
+                    isHeader[member] = true;
+                    foundHeader = true;
+                }
+            }
+            if (!foundHeader)
+            {
+                isHeader[component.front()] = true; // Unreachable loop
+            }
+            toSplit.push_back(std::move(component));
+        }
+    }
+    return depths;
+}
+
+FunctionLoopDepths::FunctionLoopDepths(FunctionDecl const *function, ASTContext &context) : myIsValid(false)
+{
+    if (function->getBody() == nullptr || function->isDependentContext())
+    {
+        return;
+    }
+    try
+    {
+        myCfg = CFG::buildCFG(function, function->getBody(), &context, getCFGBuildOptions());
+    }
+    catch (std::exception &)
+    {
+        myCfg.reset();
+    }
+    if (!myCfg)
+    {
+        return;
+    }
+    myBlockDepths = computeLoopDepths(*myCfg);
+    for (auto block : *myCfg)
+    {
+        for (auto &element : *block)
+        {
+            if (auto statement = element.getAs<CFGStmt>())
+            {
+                myDepths[statement->getStmt()] = myBlockDepths[block->getBlockID()];
+            }
+        }
+        // Conditions of loops and branches
+        if (auto terminator = block->getTerminator().getStmt())
+        {
+            myDepths.emplace(terminator, myBlockDepths[block->getBlockID()]);
+        }
+    }
+    myIsValid = true;
+}
+
+bool FunctionLoopDepths::isValid() const
+{
+    return myIsValid;
+}
+
+bool FunctionLoopDepths::getDepth(Stmt const *stmt, unsigned &depth) const
+{
+    auto it = myDepths.find(stmt);
+    if (it == myDepths.end())
+    {
+        return false;
+    }
+    depth = it->second;
+    return true;
+}
+
+CFG const *FunctionLoopDepths::getCFG() const
+{
+    return myCfg.get();
+}
+
+unsigned FunctionLoopDepths::getBlockDepth(CFGBlock const &block) const
+{
+    return myBlockDepths[block.getBlockID()];
+}
+
+LoopDepthFinder::LoopDepthFinder(ASTContext &context) : myContext(context)
+{
+}
+
+FunctionDecl const *LoopDepthFinder::findEnclosingFunction(GenericAstNode *node, GenericAstNode *&functionNode, unsigned &enclosingLoops)
+{
+    enclosingLoops = 0;
+    for (; node != nullptr; node = node->myParent)
+    {
+        if (auto stmt = getStmt(node))
+        {
+            if (auto lambda = dyn_cast<LambdaExpr>(stmt))
+            {
+                functionNode = node;
+                return lambda->getCallOperator(); // The body of the lambda is not in the graph of the enclosing function
+            }
+            else if (isLoop(stmt))
+            {
+                ++enclosingLoops;
+            }
+        }
+        else if (auto decl = boost::get<Decl *>(&node->myAstNode))
+        {
+            if (auto function = dyn_cast_or_null<FunctionDecl>(*decl))
+            {
+                functionNode = node;
+                return function;
+            }
+        }
+    }
+    return nullptr;
+}
+
+FunctionLoopDepths const &LoopDepthFinder::getDepths(FunctionDecl const *function)
+{
+    auto &depths = myDepths[function];
+    if (depths == nullptr)
+    {
+        depths = std::make_unique<FunctionLoopDepths>(function, myContext);
+    }
+    return *depths;
+}
+
+unsigned LoopDepthFinder::getLoopDepth(GenericAstNode const *site, std::string &functionName)
+{
+    GenericAstNode *functionNode = nullptr;
+    unsigned enclosingLoops = 0;
+    auto function = findEnclosingFunction(site->myParent, functionNode, enclosingLoops);
+    if (function == nullptr)
+    {
+        return enclosingLoops; // Global initializers...
+    }
+    functionName = function->getQualifiedNameAsString();
+    auto &depths = getDepths(function);
+    if (!depths.isValid())
+    {
+        return enclosingLoops;
+    }
+    // Sub-expressions are not elements of the graph, the statement that contains them is
+    for (auto node = site; node != nullptr && getStmt(node) != nullptr; node = node->myParent)
+    {
+        unsigned depth = 0;
+        if (depths.getDepth(getStmt(node), depth))
+        {
+            return depth;
+        }
+    }
+    return enclosingLoops;
+}
+
+bool LoopDepthFinder::annotateFunction(GenericAstNode *node, unsigned hotDepth)
+{
+    GenericAstNode *functionNode = nullptr;
+    unsigned enclosingLoops = 0;
+    auto function = findEnclosingFunction(node, functionNode, enclosingLoops);
+    if (function == nullptr)
+    {
+        return false;
+    }
+    if (!myAnnotatedFunctions.insert(functionNode).second)
+    {
+        return true;
+    }
+    auto &depths = getDepths(function);
+    // Depth of each statement, inherited from the parent when it is not in the graph. Without graph (templates),
+    // loop statements are counted instead.
+    std::vector<std::pair<GenericAstNode *, unsigned>> toVisit;
+    for (auto &child : functionNode->myChidren)
+    {
+        toVisit.emplace_back(child.get(), 0);
+    }
+    std::vector<GenericAstNode *> statements; // Parents before children
+    std::unordered_map<GenericAstNode *, unsigned> nodeDepths;
+    while (!toVisit.empty())
+    {
+        auto current = toVisit.back();
+        toVisit.pop_back();
+        auto stmt = getStmt(current.first);
+        if (stmt == nullptr || isa<LambdaExpr>(stmt))
+        {
+            continue; // Lambdas are annotated with their own graph
+        }
+        auto depth = current.second;
+        if (!depths.isValid() || !depths.getDepth(stmt, depth))
+        {
+            depth = current.second;
+        }
+        current.first->setProperty("Loop depth", std::to_string(depth));
+        nodeDepths[current.first] = depth;
+        statements.push_back(current.first);
+        auto childDepth = !depths.isValid() && isLoop(stmt) ? depth + 1 : depth;
+        for (auto &child : current.first->myChidren)
+        {
+            toVisit.emplace_back(child.get(), childDepth);
+        }
+    }
+
+    // Children before parents, so that what a statement contains is known when it is visited
+    std::unordered_map<GenericAstNode *, std::string> contents; // "call", "allocation"...
+    for (auto it = statements.rbegin(); it != statements.rend(); ++it)
+    {
+        auto current = *it;
+        auto stmt = getStmt(current);
+        auto &content = contents[current];
+        if (isa<CXXNewExpr>(stmt))
+        {
+            content = "allocation";
+        }
+        else if (isa<CallExpr>(stmt) && content.empty())
+        {
+            content = "call";
+        }
+        auto parent = current->myParent;
+        auto parentStmt = parent != nullptr ? getStmt(parent) : nullptr;
+        if (parentStmt != nullptr && !content.empty() && contents[parent] != "allocation")
+        {
+            contents[parent] = content;
+        }
+        // Only plain statements are highlighted, not the compound statements or loops that contain them
+        auto isStatement = isa<Expr>(stmt) ? parentStmt == nullptr || !isa<Expr>(parentStmt) : isa<DeclStmt>(stmt) || isa<ReturnStmt>(stmt);
+        if (isStatement && !content.empty() && nodeDepths[current] >= hotDepth)
+        {
+            current->isHighlighted = true;
+            current->setProperty("Hot statement", (content == "call" ? "Call" : "Allocation") + std::string(" at loop depth ") + std::to_string(nodeDepths[current]));
+        }
+    }
+    return true;
+}
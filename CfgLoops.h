@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/Analysis/CFG.h>
+#pragma warning (pop)
+
+class GenericAstNode;
+
+// Loop nesting depth of each block of a control flow graph, by block ID. Loops are found from the cycles of the
+// graph, so loops made of gotos are found too. A cycle with several entries counts as one loop.
+std::vector<unsigned> computeLoopDepths(clang::CFG const &cfg);
+
+// Loop depth of the statements of a function, from the control flow graph built with getCFGBuildOptions. The
+// graph is kept, with the depth of its blocks.
+class FunctionLoopDepths
+{
+public:
+    FunctionLoopDepths(clang::FunctionDecl const *function, clang::ASTContext &context);
+    bool isValid() const; // False if no graph could be built (dependent code, no body...)
+    // Return false if the statement is not an element of the graph. Sub-expressions usually are not, the
+    // caller has to look for the enclosing statements.
+    bool getDepth(clang::Stmt const *stmt, unsigned &depth) const;
+    clang::CFG const *getCFG() const; // nullptr if not valid
+    unsigned getBlockDepth(clang::CFGBlock const &block) const;
+private:
+    std::unique_ptr<clang::CFG> myCfg;
+    std::vector<unsigned> myBlockDepths; // By block ID
+    std::unordered_map<clang::Stmt const *, unsigned> myDepths;
+    bool myIsValid;
+};
+
+// Loop depth of nodes of the tree, in the graph of their enclosing function (or lambda). Each graph is built once.
+// In templates, that have no graph, the loop depth is the number of enclosing loop statements.
+class LoopDepthFinder
+{
+public:
+    LoopDepthFinder(clang::ASTContext &context);
+    // Also gives the name of the enclosing function
+    unsigned getLoopDepth(GenericAstNode const *node, std::string &functionName);
+    // Sets the loop depth of all the statements of the function (or lambda) containing node as a property, and
+    // highlights the statements at hotDepth or deeper that contain calls or allocations. Each function is
+    // annotated once. Return false if node is not in a function.
+    bool annotateFunction(GenericAstNode *node, unsigned hotDepth);
+private:
+    // Starts at node itself. The function node can be a LambdaExpr. Also counts the loop statements on the way.
+    clang::FunctionDecl const *findEnclosingFunction(GenericAstNode *node, GenericAstNode *&functionNode, unsigned &enclosingLoops);
+    FunctionLoopDepths const &getDepths(clang::FunctionDecl const *function);
+    clang::ASTContext &myContext;
+    std::unordered_map<clang::FunctionDecl const *, std::unique_ptr<FunctionLoopDepths>> myDepths;
+    std::unordered_set<GenericAstNode const *> myAnnotatedFunctions;
+};
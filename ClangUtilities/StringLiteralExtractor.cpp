@@ -11,8 +11,14 @@
 #include <clang/Basic/CharInfo.h>
 #include <llvm/ADT/StringExtras.h>
 #include <llvm/Support/ConvertUTF.h>
+#include <llvm/Support/MathExtras.h>
 #pragma warning (pop)
 
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define STRING_LITERAL_EXTRACTOR_USE_SSE2
+#endif
+
 
 using namespace clang;
 
@@ -245,6 +251,79 @@ bool convertUTF32ToUTF8String(ArrayRef<char> SrcBytes, std::string &Out) {
 }
 
 
+namespace {
+
+bool isSpecialInStringLiteral(char c)
+{
+    return c == '"' || c == '\\' || c == '?' || c == '\n' || c == '\r';
+}
+
+// Return a pointer to the first character that may need the lexer (end of string, escape, trigraph, end of line), or end
+const char *findSpecialInStringLiteral(const char *current, const char *end)
+{
+#ifdef STRING_LITERAL_EXTRACTOR_USE_SSE2
+    auto const quote = _mm_set1_epi8('"');
+    auto const backslash = _mm_set1_epi8('\\');
+    auto const question = _mm_set1_epi8('?');
+    auto const newLine = _mm_set1_epi8('\n');
+    auto const carriageReturn = _mm_set1_epi8('\r');
+    while (end - current >= 16)
+    {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<__m128i const *>(current));
+        auto matches = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, question), _mm_or_si128(_mm_cmpeq_epi8(chunk, newLine), _mm_cmpeq_epi8(chunk, carriageReturn))));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(matches));
+        if (mask != 0)
+        {
+            return current + llvm::countTrailingZeros(mask);
+        }
+        current += 16;
+    }
+#endif
+    for (; current != end; ++current)
+    {
+        if (isSpecialInStringLiteral(*current))
+        {
+            return current;
+        }
+    }
+    return end;
+}
+
+} // namespace
+
+bool getPlainStringLiteralSpelling(const char *tokenStart, const char *bufferEnd, std::string &spelling)
+{
+    auto current = tokenStart;
+    // Encoding prefixes are copied as they are, raw strings (and user defined literals) are left to the lexer
+    if (bufferEnd - current >= 2 && current[0] == 'u' && current[1] == '8')
+    {
+        current += 2;
+    }
+    else if (current != bufferEnd && (*current == 'u' || *current == 'U' || *current == 'L'))
+    {
+        ++current;
+    }
+    if (current == bufferEnd || *current != '"')
+    {
+        return false;
+    }
+    auto closingQuote = findSpecialInStringLiteral(current + 1, bufferEnd);
+    if (closingQuote == bufferEnd || *closingQuote != '"')
+    {
+        return false;
+    }
+    auto tokenEnd = closingQuote + 1;
+    if (tokenEnd != bufferEnd && (isIdentifierBody(*tokenEnd) || *tokenEnd == '\\'))
+    {
+        return false; // User defined literal suffix, or something else we do not want to deal with
+    }
+    spelling.assign(tokenStart, tokenEnd);
+    return true;
+}
+
+
 // This function is an adaptation from StringLiteral::getLocationOfByte in llvm-3.7.1\src\tools\clang\lib\AST\Expr.cpp
 std::vector<std::string>
 splitStringLiteral(StringLiteral *S, const SourceManager &SM, const LangOptions &Features, const TargetInfo &Target)
@@ -272,6 +351,14 @@ splitStringLiteral(StringLiteral *S, const SourceManager &SM, const LangOptions
 
         const char *StrData = Buffer.data() + LocInfo.second;
 
+        // Most literals do not contain anything that requires the lexer, in that case the spelling is just a copy of the source
+        std::string plainSpelling;
+        if (getPlainStringLiteralSpelling(StrData, Buffer.end(), plainSpelling))
+        {
+            result.push_back(std::move(plainSpelling));
+            continue;
+        }
+
         // Create a lexer starting at the beginning of this token.
         Lexer TheLexer(SM.getLocForStartOfFile(LocInfo.first), Features,
             Buffer.begin(), StrData, Buffer.end());
@@ -39,6 +39,10 @@ int MeasureUCNEscape(const char *ThisTokBegin, const char *&ThisTokBuf,
 bool convertUTF32ToUTF8String(llvm::ArrayRef<char> SrcBytes, std::string &Out);
 
 
+// Return false if the token starting at tokenStart is not a string literal that can be spelled without the lexer
+// (no escape sequence, UCN, trigraph, line continuation, raw string or user defined suffix)
+bool getPlainStringLiteralSpelling(const char *tokenStart, const char *bufferEnd, std::string &spelling);
+
 std::vector<std::string>
 splitStringLiteral(clang::StringLiteral *S, const clang::SourceManager &SM, const clang::LangOptions &Features, const clang::TargetInfo &Target);
 
@@ -0,0 +1,261 @@
+#include "CodeGenCache.h"
+#include "InMemoryCompiler.h"
+#include <sstream>
+#include <mutex>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/Frontend/TextDiagnosticBuffer.h>
+#include <llvm/ADT/Hashing.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/GlobalAlias.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#pragma warning (pop)
+
+namespace
+{
+
+llvm::CodeGenOpt::Level getCodeGenLevel(std::string const &optimization)
+{
+    return optimization == "-O0" ? llvm::CodeGenOpt::None :
+        optimization == "-O1" ? llvm::CodeGenOpt::Less :
+        optimization == "-O3" ? llvm::CodeGenOpt::Aggressive :
+        llvm::CodeGenOpt::Default;
+}
+
+bool isInstruction(std::string const &line)
+{
+    if (line.empty() || (line[0] != ' ' && line[0] != '\t'))
+    {
+        return false; // Label
+    }
+    auto start = line.find_first_not_of(" \t");
+    if (start == std::string::npos)
+    {
+        return false;
+    }
+    auto first = line[start];
+    return first != '.' && first != '#' && first != ';' && first != '@' && line.back() != ':';
+}
+
+// Assigns the lines of the assembly to the functions that are cached
+void splitAssembly(std::string const &assembly, std::unordered_map<std::string, std::shared_ptr<FunctionCode>> &codes)
+{
+    std::istringstream lines(assembly);
+    std::string line;
+    FunctionCode *current = nullptr;
+    while (std::getline(lines, line))
+    {
+        if (line.compare(0, 10, ".Lfunc_end") == 0)
+        {
+            current = nullptr;
+            continue;
+        }
+        if (!line.empty() && line[0] != ' ' && line[0] != '\t' && line.back() == ':')
+        {
+            auto name = line.substr(0, line.size() - 1);
+            if (name.size() > 2 && name.front() == '"' && name.back() == '"')
+            {
+                name = name.substr(1, name.size() - 2); // Microsoft manglings are quoted
+            }
+            auto code = codes.find(name);
+            if (code == codes.end() && name.size() > 1 && name[0] == '_')
+            {
+                code = codes.find(name.substr(1)); // Mach-O prefixes the symbols
+            }
+            if (code != codes.end())
+            {
+                current = code->second.get();
+            }
+            else if (name[0] != '.' && name[0] != 'L' && name[0] != '$')
+            {
+                current = nullptr; // Another function, or data
+            }
+        }
+        if (current == nullptr)
+        {
+            continue;
+        }
+        current->assembly += line + "\n";
+        if (isInstruction(line))
+        {
+            ++current->machineInstructions;
+        }
+        if (line.find(".cfi_endproc") != std::string::npos || line.find(".seh_endproc") != std::string::npos)
+        {
+            current = nullptr;
+        }
+    }
+}
+
+} // namespace
+
+
+uint64_t CodeGenCache::computeKey(std::string const &mangledName, std::string const &sourceText, std::vector<std::string> const &args, std::string const &optimization)
+{
+    auto key = llvm::hash_combine(mangledName, sourceText, optimization);
+    for (auto &arg : args)
+    {
+        key = llvm::hash_combine(key, arg);
+    }
+    return key;
+}
+
+std::shared_ptr<FunctionCode const> CodeGenCache::find(uint64_t key)
+{
+    auto it = myCache.find(key);
+    return it != myCache.end() ? it->second : nullptr;
+}
+
+void CodeGenCache::startCompilation(std::string const &sourceCode, std::vector<std::string> const &args, std::string const &optimization,
+    std::unordered_map<std::string, uint64_t> functions)
+{
+    if (myCompilation.valid())
+    {
+        return;
+    }
+    myCompilation = std::async(std::launch::async, [sourceCode, args, optimization, functions]()
+    {
+        return compile(sourceCode, args, optimization, functions);
+    });
+}
+
+bool CodeGenCache::compiling()
+{
+    return myCompilation.valid();
+}
+
+bool CodeGenCache::finishCompilation(std::string &error)
+{
+    if (!myCompilation.valid() || myCompilation.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        return false;
+    }
+    auto result = myCompilation.get();
+    error = result.error;
+    for (auto &function : result.functions)
+    {
+        myCache[function.first] = function.second;
+    }
+    return true;
+}
+
+void CodeGenCache::clear()
+{
+    if (myCompilation.valid())
+    {
+        myCompilation.wait();
+        myCompilation = {};
+    }
+    myCache.clear();
+}
+
+CodeGenCache::CompilationResult CodeGenCache::compile(std::string const &sourceCode, std::vector<std::string> const &args, std::string const &optimization,
+    std::unordered_map<std::string, uint64_t> const &functions)
+{
+    static std::once_flag targetsInitialized;
+    std::call_once(targetsInitialized, []()
+    {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+    });
+    CompilationResult result;
+
+    clang::TextDiagnosticBuffer diagnostics;
+    llvm::LLVMContext llvmContext;
+    auto module = compileInMemory(sourceCode, args, { optimization.c_str() }, diagnostics, llvmContext, result.error);
+    if (module == nullptr)
+    {
+        for (auto error = diagnostics.err_begin(); error != diagnostics.err_end(); ++error)
+        {
+            result.error += "\n" + error->second;
+        }
+        return result;
+    }
+
+    std::unordered_map<std::string, std::shared_ptr<FunctionCode>> codes; // By name of the emitted function
+    std::unordered_map<std::string, std::string> emittedNames; // Complete constructors and destructors may be aliases of the base ones
+    for (auto &function : functions)
+    {
+        auto emitted = module->getFunction(function.first);
+        if (emitted == nullptr)
+        {
+            if (auto alias = module->getNamedAlias(function.first))
+            {
+                emitted = llvm::dyn_cast<llvm::Function>(alias->getAliasee()->stripPointerCasts());
+            }
+        }
+        if (emitted == nullptr || emitted->isDeclaration())
+        {
+            continue;
+        }
+        emittedNames[function.first] = emitted->getName();
+        if (codes.count(emitted->getName()) != 0)
+        {
+            continue;
+        }
+        auto code = std::make_shared<FunctionCode>(FunctionCode{ "", "", 0, 0, true });
+        llvm::raw_string_ostream ir(code->ir);
+        emitted->print(ir);
+        ir.flush();
+        for (auto &block : *emitted)
+        {
+            code->irInstructions += static_cast<unsigned>(block.size());
+        }
+        codes[emitted->getName()] = code;
+    }
+
+    // The IR is printed first, since machine code generation transforms the module
+    std::string targetError;
+    auto target = llvm::TargetRegistry::lookupTarget(module->getTargetTriple(), targetError);
+    std::unique_ptr<llvm::TargetMachine> machine(target == nullptr ? nullptr :
+        target->createTargetMachine(module->getTargetTriple(), "", "", llvm::TargetOptions(), llvm::Optional<llvm::Reloc::Model>(),
+            llvm::CodeModel::Default, getCodeGenLevel(optimization)));
+    std::string assemblyError;
+    if (machine == nullptr)
+    {
+        assemblyError = "No machine code for target " + module->getTargetTriple() + " " + targetError; // Only the native target is linked
+    }
+    else
+    {
+        module->setDataLayout(machine->createDataLayout());
+        llvm::SmallString<0> assembly;
+        llvm::raw_svector_ostream stream(assembly);
+        llvm::legacy::PassManager passes;
+        if (machine->addPassesToEmitFile(passes, stream, llvm::TargetMachine::CGFT_AssemblyFile))
+        {
+            assemblyError = "The target cannot emit assembly";
+        }
+        else
+        {
+            passes.run(*module);
+            splitAssembly(assembly.str(), codes);
+        }
+    }
+    if (!assemblyError.empty())
+    {
+        // The IR is still worth showing, and compiling again would fail the same way
+        for (auto &code : codes)
+        {
+            code.second->assemblyError = assemblyError;
+        }
+    }
+
+    for (auto &function : functions)
+    {
+        auto emittedName = emittedNames.find(function.first);
+        auto code = emittedName != emittedNames.end() ? codes.find(emittedName->second) : codes.end();
+        result.functions[function.second] = code != codes.end() ?
+            std::shared_ptr<FunctionCode const>(code->second) :
+            std::make_shared<FunctionCode const>(FunctionCode{ "", "", 0, 0, false });
+    }
+    return result;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <cstdint>
+#include <unordered_map>
+
+// Optimized LLVM IR and machine code of a function
+struct FunctionCode
+{
+    std::string ir;
+    std::string assembly;
+    unsigned irInstructions;
+    unsigned machineInstructions;
+    bool emitted; // False if the function was not emitted (inlined everywhere, unused inline function, alias...)
+    std::string assemblyError; // Why there is no assembly (no target machine...), cached with the IR. Empty if there is
+};
+
+// The translation unit is compiled as a whole in a background thread, with its own compiler instance, so that
+// the viewer can still be used meanwhile. The code of all the functions it defines is cached at once, by a key
+// computed from the mangled name and the source text of the function, the command line and the optimization
+// level. Changes in the functions it calls (that may be inlined) are not seen until the cache is cleared.
+class CodeGenCache
+{
+public:
+    static uint64_t computeKey(std::string const &mangledName, std::string const &sourceText, std::vector<std::string> const &args, std::string const &optimization);
+    std::shared_ptr<FunctionCode const> find(uint64_t key); // nullptr if not cached
+    // functions are the keys of the functions to cache, by mangled name. Does nothing if a compilation is running
+    void startCompilation(std::string const &sourceCode, std::vector<std::string> const &args, std::string const &optimization,
+        std::unordered_map<std::string, uint64_t> functions);
+    bool compiling(); // True until the result is merged in the cache
+    // Merges the result of the compilation in the cache, if it has finished. Returns false if it has not.
+    bool finishCompilation(std::string &error);
+    void clear(); // Waits for the running compilation, if any
+private:
+    struct CompilationResult
+    {
+        std::unordered_map<uint64_t, std::shared_ptr<FunctionCode const>> functions;
+        std::string error;
+    };
+    static CompilationResult compile(std::string const &sourceCode, std::vector<std::string> const &args, std::string const &optimization,
+        std::unordered_map<std::string, uint64_t> const &functions);
+    std::unordered_map<uint64_t, std::shared_ptr<FunctionCode const>> myCache;
+    std::future<CompilationResult> myCompilation;
+};
@@ -1,89 +1,262 @@
-#ifdef _WIN32
-#include <windows.h>
-#else
-#include <wordexp.h>
-#endif
+#include "CommandLineSplitter.h"
 
-#include <vector>
-#include <string>
-#include <cassert>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
 
-std::vector<std::string> splitCommandLine(std::string const &cmdline)
+namespace
 {
-    int i;
-    char **argv = NULL;
-    int argc;
-    std::vector<std::string> result;
-    // Posix.
-#ifndef _WIN32
-    {
-        wordexp_t p;
 
-        // Note! This expands shell variables.
-        if (wordexp(cmdline.c_str(), &p, 0))
-        {
-            return NULL;
-        }
+size_t const maxResponseFileDepth = 16; // Cycles are detected by name, this catches the ones spelled differently
+
+struct ResponseFiles
+{
+    std::vector<std::string> open; // Being read, innermost last
+    bool used;
+    std::string error; // The first one
+};
 
-        argc = p.we_wordc;
+bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
 
-        if (!(argv = calloc(argc, sizeof(char *))))
+#ifdef _WIN32
+// Same rules as CommandLineToArgvW: backslashes are only special before a double quote, so that
+// paths such as "C:\Program Files\" can be written naturally
+void readToken(std::string const &cmdline, size_t &i, std::string &token)
+{
+    auto size = cmdline.size();
+    bool inQuotes = false;
+    while (i < size && (inQuotes || !isBlank(cmdline[i])))
+    {
+        auto c = cmdline[i];
+        if (c == '\\')
         {
-            goto fail;
+            size_t backslashes = 0;
+            while (i < size && cmdline[i] == '\\')
+            {
+                ++backslashes;
+                ++i;
+            }
+            if (i < size && cmdline[i] == '"')
+            {
+                token.append(backslashes / 2, '\\');
+                if (backslashes % 2 == 1)
+                {
+                    token += '"';
+                    ++i;
+                }
+                // Otherwise, the quote is processed by the next iteration
+            }
+            else
+            {
+                token.append(backslashes, '\\');
+            }
         }
-
-        for (i = 0; i < p.we_wordc; i++)
+        else if (c == '"')
         {
-            result.push_back(p.we_wordv[i]);
+            if (inQuotes && i + 1 < size && cmdline[i + 1] == '"')
+            {
+                token += '"';
+                i += 2;
+            }
+            else
+            {
+                inQuotes = !inQuotes;
+                ++i;
+            }
+        }
+        else
+        {
+            token += c;
+            ++i;
         }
-
-        wordfree(&p);
-
-        return result;
-    fail:
-        wordfree(&p);
     }
-#else // WIN32
+}
+#else
+// POSIX shell quoting rules, without any kind of expansion
+void readToken(std::string const &cmdline, size_t &i, std::string &token)
+{
+    auto size = cmdline.size();
+    char quote = 0;
+    while (i < size && (quote != 0 || !isBlank(cmdline[i])))
     {
-        wchar_t **wargs = NULL;
-        size_t needed = 0;
-        wchar_t *cmdlinew = NULL;
-        size_t len = cmdline.size() + 1;
+        auto c = cmdline[i++];
+        if (quote == '\'')
+        {
+            if (c == '\'')
+                quote = 0;
+            else
+                token += c;
+        }
+        else if (quote == '"')
+        {
+            if (c == '"')
+            {
+                quote = 0;
+            }
+            else if (c == '\\' && i < size && (cmdline[i] == '"' || cmdline[i] == '\\' || cmdline[i] == '$' || cmdline[i] == '`' || cmdline[i] == '\n'))
+            {
+                if (cmdline[i] != '\n')
+                    token += cmdline[i];
+                ++i;
+            }
+            else
+            {
+                token += c;
+            }
+        }
+        else if (c == '\'' || c == '"')
+        {
+            quote = c;
+        }
+        else if (c == '\\')
+        {
+            if (i < size)
+            {
+                if (cmdline[i] != '\n') // Line continuation
+                    token += cmdline[i];
+                ++i;
+            }
+        }
+        else
+        {
+            token += c;
+        }
+    }
+}
+#endif
+
+#ifdef _WIN32
+bool isSeparator(char c)
+{
+    return c == '/' || c == '\\';
+}
 
-        if (!(cmdlinew = static_cast<wchar_t*>(calloc(len, sizeof(wchar_t)))))
-            goto fail;
+bool isAbsolute(std::string const &path)
+{
+    return (!path.empty() && isSeparator(path[0])) || (path.size() > 1 && path[1] == ':');
+}
+#else
+bool isSeparator(char c)
+{
+    return c == '/';
+}
 
-        if (!MultiByteToWideChar(CP_ACP, 0, cmdline.c_str(), -1, cmdlinew, len))
-            goto fail;
+bool isAbsolute(std::string const &path)
+{
+    return !path.empty() && path[0] == '/';
+}
+#endif
 
-        if (!(wargs = CommandLineToArgvW(cmdlinew, &argc)))
-            goto fail;
+// Directory part of path, with its trailing separator, or an empty string
+std::string getDirectory(std::string const &path)
+{
+    auto end = std::find_if(path.rbegin(), path.rend(), isSeparator);
+    return std::string(path.begin(), end.base());
+}
 
-        // Convert from wchar_t * to ANSI char *
-        for (i = 0; i < argc; i++)
+// Removes the . and dir/.. components, so that a file reached through different relative paths has one name
+std::string normalizePath(std::string const &path)
+{
+    std::vector<std::string> components;
+    size_t start = 0;
+    while (start <= path.size())
+    {
+        auto end = std::find_if(path.begin() + start, path.end(), isSeparator) - path.begin();
+        auto component = path.substr(start, end - start);
+        if (component == ".." && !components.empty() && components.back() != ".." && !components.back().empty())
         {
-            // Get the size needed for the target buffer.
-            // CP_ACP = Ansi Codepage.
-            needed = WideCharToMultiByte(CP_ACP, 0, wargs[i], -1,
-                NULL, 0, NULL, NULL);
-            char *argv;
-            if (!(argv = static_cast<char*>(malloc(needed))))
-                goto fail;
+            components.pop_back();
+        }
+        else if (component != "." && (component != "" || components.empty()))
+        {
+            components.push_back(component); // An empty first component is the root of an absolute path
+        }
+        start = end + 1;
+    }
+    std::string result = components.front();
+    for (size_t i = 1; i < components.size(); ++i)
+    {
+        result += "/" + components[i];
+    }
+    return result;
+}
 
-            // Do the conversion.
-            needed = WideCharToMultiByte(CP_ACP, 0, wargs[i], -1,
-                argv, needed, NULL, NULL);
-            result.push_back(argv);
-            free(argv);
+// Relative names are relative to the directory of the file that contains them, like clang does
+void tokenize(std::string const &cmdline, std::vector<std::string> &result, std::string const &directory, ResponseFiles &files)
+{
+    size_t i = 0;
+    while (true)
+    {
+        while (i < cmdline.size() && isBlank(cmdline[i]))
+        {
+            ++i;
+        }
+        if (i == cmdline.size())
+        {
+            return;
         }
+        bool isResponseFile = cmdline[i] == '@';
+        std::string token;
+        readToken(cmdline, i, token);
+        if (isResponseFile)
+        {
+            auto fileName = token.substr(1);
+            if (!isAbsolute(fileName))
+            {
+                fileName = directory + fileName;
+            }
+            fileName = normalizePath(fileName);
+            if (std::find(files.open.begin(), files.open.end(), fileName) != files.open.end())
+            {
+                if (files.error.empty())
+                {
+                    files.error = "The response file " + fileName + " includes itself";
+                }
+                continue;
+            }
+            if (files.open.size() == maxResponseFileDepth)
+            {
+                if (files.error.empty())
+                {
+                    files.error = "The response files are nested too deeply (more than " + std::to_string(maxResponseFileDepth) + " levels) to include " + fileName;
+                }
+                continue;
+            }
+            std::ifstream file(fileName);
+            if (file)
+            {
+                files.used = true;
+                std::stringstream content;
+                content << file.rdbuf();
+                files.open.push_back(fileName);
+                tokenize(content.str(), result, getDirectory(fileName), files);
+                files.open.pop_back();
+                continue;
+            }
+            // Like gcc and clang, if the file cannot be read, the argument is kept as it is
+        }
+        result.push_back(token);
+    }
+}
 
-        if (wargs) LocalFree(wargs);
-        if (cmdlinew) free(cmdlinew);
-        return result;
+} // namespace
 
-    fail:
-        if (wargs) LocalFree(wargs);
-        if (cmdlinew) free(cmdlinew);
+std::vector<std::string> splitCommandLine(std::string const &cmdline, bool *usesResponseFiles, std::string *error)
+{
+    std::vector<std::string> result;
+    ResponseFiles files;
+    files.used = false;
+    tokenize(cmdline, result, std::string(), files);
+    if (usesResponseFiles != nullptr)
+    {
+        *usesResponseFiles = files.used;
+    }
+    if (error != nullptr)
+    {
+        *error = files.error;
     }
-#endif // WIN32
-}
\ No newline at end of file
+    return result;
+}
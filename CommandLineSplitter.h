@@ -3,4 +3,8 @@
 #include <vector>
 #include <string>
 
-std::vector<std::string> splitCommandLine(std::string const &cmdline);
+// Splits a command line with the quoting rules of the platform, without running a shell (no variable or
+// command expansion). @file arguments are replaced by the arguments contained in the file, relative names in a
+// file being relative to its directory. A response file that includes itself, or that is nested too deeply, is
+// skipped, and reported in error (empty if there is none).
+std::vector<std::string> splitCommandLine(std::string const &cmdline, bool *usesResponseFiles = nullptr, std::string *error = nullptr);
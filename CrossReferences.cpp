@@ -0,0 +1,628 @@
+#include "CrossReferences.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <tuple>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/RecursiveASTVisitor.h>
+#include <clang/Frontend/FrontendAction.h>
+#include <clang/Index/USRGeneration.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <clang/Tooling/Tooling.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/raw_ostream.h>
+#pragma warning (pop)
+
+using namespace clang;
+
+namespace
+{
+
+char const workerOption[] = "--xref-worker"; // Followed by the database directory, the list of files to parse and the index to write
+char const indexMagic[8] = { 'C', 'A', 'S', 'T', 'X', 'R', 'E', 'F' };
+uint32_t const indexVersion = 1;
+
+struct IndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t symbolCount;
+    uint32_t occurrenceCount;
+    uint32_t stringCount;
+    uint32_t stringDataSize;
+};
+
+struct SymbolRecord
+{
+    uint32_t usr; // Index in the string table
+    uint32_t firstOccurrence;
+    uint32_t occurrenceCount;
+};
+
+// Same layout as XRefTable::Entry, except that file is an index in the string table
+using OccurrenceRecord = XRefTable::Entry;
+
+bool isDefinition(Decl const *decl)
+{
+    if (auto function = dyn_cast<FunctionDecl>(decl))
+    {
+        return function->isThisDeclarationADefinition();
+    }
+    if (auto var = dyn_cast<VarDecl>(decl))
+    {
+        return var->isThisDeclarationADefinition() != VarDecl::DeclarationOnly;
+    }
+    if (auto tag = dyn_cast<TagDecl>(decl))
+    {
+        return tag->isThisDeclarationADefinition();
+    }
+    return true; // Other declarations (fields, enumerators, typedefs...) cannot be declared without being defined
+}
+
+class XRefCollector : public RecursiveASTVisitor<XRefCollector>
+{
+public:
+    XRefCollector(ASTContext &context, XRefTable &table) : myManager(context.getSourceManager()), myTable(table)
+    {
+    }
+
+    bool VisitNamedDecl(NamedDecl *decl)
+    {
+        if (!decl->isImplicit())
+        {
+            record(decl, decl->getLocation(), isDefinition(decl) ? XRefOccurrence::Definition : XRefOccurrence::Declaration);
+        }
+        return true;
+    }
+    bool VisitDeclRefExpr(DeclRefExpr *expr)
+    {
+        record(expr->getDecl(), expr->getLocation(), XRefOccurrence::Reference);
+        return true;
+    }
+    bool VisitMemberExpr(MemberExpr *expr)
+    {
+        record(expr->getMemberDecl(), expr->getMemberLoc(), XRefOccurrence::Reference);
+        return true;
+    }
+    bool VisitCXXConstructExpr(CXXConstructExpr *expr)
+    {
+        record(expr->getConstructor(), expr->getLocation(), XRefOccurrence::Reference);
+        return true;
+    }
+    bool VisitTagTypeLoc(TagTypeLoc typeLoc)
+    {
+        record(typeLoc.getDecl(), typeLoc.getNameLoc(), XRefOccurrence::Reference);
+        return true;
+    }
+    bool VisitTypedefTypeLoc(TypedefTypeLoc typeLoc)
+    {
+        record(typeLoc.getTypedefNameDecl(), typeLoc.getNameLoc(), XRefOccurrence::Reference);
+        return true;
+    }
+
+private:
+    void record(Decl const *decl, SourceLocation location, uint32_t kind)
+    {
+        if (decl == nullptr || location.isInvalid())
+        {
+            return;
+        }
+        auto usr = myUsrs.find(decl);
+        if (usr == myUsrs.end())
+        {
+            std::string value;
+            if (!getUsr(decl, value))
+            {
+                value.clear();
+            }
+            usr = myUsrs.emplace(decl, value).first;
+        }
+        if (usr->second.empty())
+        {
+            return;
+        }
+        // Inside macros, the name is where it is spelled if it is a macro argument, where the macro is expanded otherwise
+        auto decomposed = myManager.getDecomposedLoc(myManager.getFileLoc(location));
+        auto file = myFileNames.find(decomposed.first.getHashValue());
+        if (file == myFileNames.end())
+        {
+            auto entry = myManager.getFileEntryForID(decomposed.first);
+            // Relative names are relative to the directory of the compile command, which is the current one while it is parsed
+            llvm::SmallString<256> fileName(entry != nullptr ? entry->getName() : "");
+            if (!fileName.empty())
+            {
+                llvm::sys::fs::make_absolute(fileName);
+            }
+            file = myFileNames.emplace(decomposed.first.getHashValue(), fileName.str().str()).first;
+        }
+        if (file->second.empty())
+        {
+            return;
+        }
+        myTable.add(usr->second, file->second, decomposed.second,
+            myManager.getLineNumber(decomposed.first, decomposed.second),
+            myManager.getColumnNumber(decomposed.first, decomposed.second),
+            kind);
+    }
+
+    SourceManager &myManager;
+    XRefTable &myTable;
+    std::unordered_map<Decl const *, std::string> myUsrs; // Generating a USR is not free, and most declarations are used several times
+    std::unordered_map<unsigned, std::string> myFileNames; // By FileID hash value
+};
+
+class XRefConsumer : public ASTConsumer
+{
+public:
+    XRefConsumer(XRefTable &table) : myTable(table)
+    {
+    }
+    void HandleTranslationUnit(ASTContext &context) override
+    {
+        collectXRefs(context, myTable);
+    }
+private:
+    XRefTable &myTable;
+};
+
+class XRefAction : public ASTFrontendAction
+{
+public:
+    XRefAction(XRefTable &table) : myTable(table)
+    {
+    }
+    std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &, StringRef) override
+    {
+        return std::make_unique<XRefConsumer>(myTable);
+    }
+private:
+    XRefTable &myTable;
+};
+
+class XRefActionFactory : public tooling::FrontendActionFactory
+{
+public:
+    XRefActionFactory(XRefTable &table) : myTable(table)
+    {
+    }
+    FrontendAction *create() override
+    {
+        return new XRefAction(myTable);
+    }
+private:
+    XRefTable &myTable;
+};
+
+class StringTable
+{
+public:
+    uint32_t add(std::string const &s)
+    {
+        auto it = myIndices.find(s);
+        if (it != myIndices.end())
+        {
+            return it->second;
+        }
+        auto index = static_cast<uint32_t>(myOffsets.size());
+        myOffsets.push_back(static_cast<uint32_t>(myData.size()));
+        myData += s;
+        myIndices.emplace(s, index);
+        return index;
+    }
+    std::vector<uint32_t> offsets() const // One more than the number of strings, the last one marks the end of the data
+    {
+        auto result = myOffsets;
+        result.push_back(static_cast<uint32_t>(myData.size()));
+        return result;
+    }
+    std::string const &data() const
+    {
+        return myData;
+    }
+private:
+    std::unordered_map<std::string, uint32_t> myIndices;
+    std::vector<uint32_t> myOffsets;
+    std::string myData;
+};
+
+template<class T>
+void writeArray(llvm::raw_ostream &os, std::vector<T> const &data)
+{
+    if (!data.empty())
+    {
+        os.write(reinterpret_cast<char const *>(data.data()), data.size() * sizeof(T));
+    }
+}
+
+} // namespace
+
+
+void XRefTable::add(std::string const &usr, std::string const &file, uint32_t offset, uint32_t line, uint32_t column, uint32_t kind)
+{
+    myEntries[usr].push_back(Entry{ getFileIndex(file), offset, line, column, kind });
+}
+
+void XRefTable::merge(XRefTable const &other)
+{
+    for (auto &symbol : other.myEntries)
+    {
+        auto &entries = myEntries[symbol.first];
+        for (auto entry : symbol.second)
+        {
+            entry.file = getFileIndex(other.myFiles[entry.file]);
+            entries.push_back(entry);
+        }
+    }
+}
+
+std::vector<XRefOccurrence> XRefTable::find(std::string const &usr) const
+{
+    std::vector<XRefOccurrence> result;
+    auto it = myEntries.find(usr);
+    if (it != myEntries.end())
+    {
+        for (auto &entry : it->second)
+        {
+            result.push_back(XRefOccurrence{ myFiles[entry.file], entry.offset, entry.line, entry.column, entry.kind });
+        }
+    }
+    return result;
+}
+
+uint32_t XRefTable::getFileIndex(std::string const &file)
+{
+    auto it = myFileIndices.find(file);
+    if (it != myFileIndices.end())
+    {
+        return it->second;
+    }
+    auto index = static_cast<uint32_t>(myFiles.size());
+    myFiles.push_back(file);
+    myFileIndices.emplace(file, index);
+    return index;
+}
+
+bool XRefTable::save(std::string const &fileName) const
+{
+    std::vector<std::string const *> usrs;
+    for (auto &symbol : myEntries)
+    {
+        usrs.push_back(&symbol.first);
+    }
+    std::sort(usrs.begin(), usrs.end(), [](std::string const *left, std::string const *right) {return *left < *right; });
+
+    StringTable strings;
+    std::vector<SymbolRecord> symbols;
+    std::vector<OccurrenceRecord> occurrences;
+    for (auto usr : usrs)
+    {
+        // Headers are seen by many translation units, their occurrences are only stored once
+        auto entries = myEntries.at(*usr);
+        std::sort(entries.begin(), entries.end(), [](Entry const &left, Entry const &right)
+        {
+            return std::tie(left.file, left.offset, left.kind) < std::tie(right.file, right.offset, right.kind);
+        });
+        entries.erase(std::unique(entries.begin(), entries.end(), [](Entry const &left, Entry const &right)
+        {
+            return left.file == right.file && left.offset == right.offset && left.kind == right.kind;
+        }), entries.end());
+        symbols.push_back(SymbolRecord{ strings.add(*usr), static_cast<uint32_t>(occurrences.size()), static_cast<uint32_t>(entries.size()) });
+        for (auto entry : entries)
+        {
+            entry.file = strings.add(myFiles[entry.file]);
+            occurrences.push_back(entry);
+        }
+    }
+
+    IndexHeader header;
+    std::memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.version = indexVersion;
+    header.symbolCount = static_cast<uint32_t>(symbols.size());
+    header.occurrenceCount = static_cast<uint32_t>(occurrences.size());
+    auto offsets = strings.offsets();
+    header.stringCount = static_cast<uint32_t>(offsets.size() - 1);
+    header.stringDataSize = static_cast<uint32_t>(strings.data().size());
+
+    std::error_code error;
+    llvm::raw_fd_ostream os(fileName, error, llvm::sys::fs::F_None);
+    if (error)
+    {
+        return false;
+    }
+    os.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    writeArray(os, symbols);
+    writeArray(os, occurrences);
+    writeArray(os, offsets);
+    os << strings.data();
+    os.close();
+    return !os.has_error();
+}
+
+
+void collectXRefs(ASTContext &context, XRefTable &table)
+{
+    XRefCollector collector(context, table);
+    collector.TraverseDecl(context.getTranslationUnitDecl());
+}
+
+bool getUsr(Decl const *decl, std::string &usr)
+{
+    llvm::SmallString<128> buffer;
+    if (index::generateUSRForDecl(decl, buffer)) // Returns true on failure
+    {
+        return false;
+    }
+    usr = buffer.str();
+    return true;
+}
+
+
+bool XRefIndex::open(std::string const &fileName)
+{
+    myBuffer.reset();
+    // No null terminator required, so that the file gets memory mapped instead of copied
+    auto buffer = llvm::MemoryBuffer::getFile(fileName, -1, false);
+    if (!buffer)
+    {
+        return false;
+    }
+    auto data = (*buffer)->getBufferStart();
+    auto size = (*buffer)->getBufferSize();
+    if (size < sizeof(IndexHeader))
+    {
+        return false;
+    }
+    auto header = reinterpret_cast<IndexHeader const *>(data);
+    if (std::memcmp(header->magic, indexMagic, sizeof(indexMagic)) != 0 || header->version != indexVersion)
+    {
+        return false;
+    }
+    auto expectedSize = sizeof(IndexHeader) +
+        uint64_t(header->symbolCount) * sizeof(SymbolRecord) +
+        uint64_t(header->occurrenceCount) * sizeof(OccurrenceRecord) +
+        (uint64_t(header->stringCount) + 1) * sizeof(uint32_t) +
+        header->stringDataSize;
+    if (size != expectedSize)
+    {
+        return false;
+    }
+    // Strings are checked once here, so that lookups do not have to
+    auto offsets = reinterpret_cast<uint32_t const *>(data + size - header->stringDataSize) - (header->stringCount + 1);
+    for (uint32_t i = 0; i < header->stringCount; ++i)
+    {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > header->stringDataSize)
+        {
+            return false;
+        }
+    }
+    auto symbols = reinterpret_cast<SymbolRecord const *>(header + 1);
+    for (uint32_t i = 0; i < header->symbolCount; ++i)
+    {
+        if (symbols[i].usr >= header->stringCount || uint64_t(symbols[i].firstOccurrence) + symbols[i].occurrenceCount > header->occurrenceCount)
+        {
+            return false;
+        }
+    }
+    auto occurrences = reinterpret_cast<OccurrenceRecord const *>(symbols + header->symbolCount);
+    for (uint32_t i = 0; i < header->occurrenceCount; ++i)
+    {
+        if (occurrences[i].file >= header->stringCount)
+        {
+            return false;
+        }
+    }
+    myBuffer = std::move(*buffer);
+    return true;
+}
+
+bool XRefIndex::isOpen() const
+{
+    return myBuffer != nullptr;
+}
+
+std::vector<XRefOccurrence> XRefIndex::find(std::string const &usr) const
+{
+    std::vector<XRefOccurrence> result;
+    if (!isOpen())
+    {
+        return result;
+    }
+    auto data = myBuffer->getBufferStart();
+    auto header = reinterpret_cast<IndexHeader const *>(data);
+    auto symbols = reinterpret_cast<SymbolRecord const *>(header + 1);
+    auto occurrences = reinterpret_cast<OccurrenceRecord const *>(symbols + header->symbolCount);
+    auto offsets = reinterpret_cast<uint32_t const *>(occurrences + header->occurrenceCount);
+    auto stringData = reinterpret_cast<char const *>(offsets + header->stringCount + 1);
+    auto getString = [&](uint32_t index)
+    {
+        return llvm::StringRef(stringData + offsets[index], offsets[index + 1] - offsets[index]);
+    };
+
+    auto symbol = std::lower_bound(symbols, symbols + header->symbolCount, llvm::StringRef(usr), [&](SymbolRecord const &record, llvm::StringRef value)
+    {
+        return getString(record.usr) < value;
+    });
+    if (symbol == symbols + header->symbolCount || getString(symbol->usr) != usr)
+    {
+        return result;
+    }
+    for (auto o = symbol->firstOccurrence; o != symbol->firstOccurrence + symbol->occurrenceCount; ++o)
+    {
+        auto &occurrence = occurrences[o];
+        result.push_back(XRefOccurrence{ getString(occurrence.file), occurrence.offset, occurrence.line, occurrence.column, occurrence.kind });
+    }
+    return result;
+}
+
+
+void XRefIndex::addTo(XRefTable &table) const
+{
+    if (!isOpen())
+    {
+        return;
+    }
+    auto data = myBuffer->getBufferStart();
+    auto header = reinterpret_cast<IndexHeader const *>(data);
+    auto symbols = reinterpret_cast<SymbolRecord const *>(header + 1);
+    auto occurrences = reinterpret_cast<OccurrenceRecord const *>(symbols + header->symbolCount);
+    auto offsets = reinterpret_cast<uint32_t const *>(occurrences + header->occurrenceCount);
+    auto stringData = reinterpret_cast<char const *>(offsets + header->stringCount + 1);
+    auto getString = [&](uint32_t index)
+    {
+        return std::string(stringData + offsets[index], offsets[index + 1] - offsets[index]);
+    };
+    for (auto symbol = symbols; symbol != symbols + header->symbolCount; ++symbol)
+    {
+        auto usr = getString(symbol->usr);
+        for (auto o = symbol->firstOccurrence; o != symbol->firstOccurrence + symbol->occurrenceCount; ++o)
+        {
+            auto &occurrence = occurrences[o];
+            table.add(usr, getString(occurrence.file), occurrence.offset, occurrence.line, occurrence.column, occurrence.kind);
+        }
+    }
+}
+
+bool buildXRefIndex(std::string const &directory, std::string const &indexFile, std::string const &executable, std::string &error)
+{
+    // The workers get absolute paths, they do not depend on the current directory
+    llvm::SmallString<256> absoluteDirectory(directory);
+    llvm::SmallString<256> absoluteIndexFile(indexFile);
+    if (llvm::sys::fs::make_absolute(absoluteDirectory) || llvm::sys::fs::make_absolute(absoluteIndexFile))
+    {
+        error = "Cannot get the absolute path of " + directory;
+        return false;
+    }
+    auto database = tooling::CompilationDatabase::loadFromDirectory(absoluteDirectory.str(), error);
+    if (database == nullptr)
+    {
+        return false;
+    }
+    auto files = database->getAllFiles();
+    auto workerCount = std::max(1u, std::min(std::thread::hardware_concurrency(), static_cast<unsigned>(files.size())));
+
+    struct Worker
+    {
+        llvm::SmallString<256> fileList;
+        llvm::SmallString<256> index;
+        llvm::sys::ProcessInfo process;
+    };
+    std::vector<Worker> workers(workerCount);
+    auto removeFiles = [&workers]()
+    {
+        for (auto &worker : workers)
+        {
+            if (!worker.fileList.empty())
+            {
+                llvm::sys::fs::remove(worker.fileList);
+            }
+            if (!worker.index.empty())
+            {
+                llvm::sys::fs::remove(worker.index);
+            }
+        }
+    };
+    for (unsigned i = 0; i < workerCount; ++i)
+    {
+        auto &worker = workers[i];
+        if (llvm::sys::fs::createTemporaryFile("xref-files", "txt", worker.fileList) ||
+            llvm::sys::fs::createTemporaryFile("xref-part", "xref", worker.index))
+        {
+            error = "Cannot create the temporary files of the workers";
+            removeFiles();
+            return false;
+        }
+        std::error_code fileError;
+        llvm::raw_fd_ostream os(worker.fileList, fileError, llvm::sys::fs::F_Text);
+        if (fileError)
+        {
+            error = "Cannot write " + worker.fileList.str().str();
+            removeFiles();
+            return false;
+        }
+        // Interleaved, files from the same directory often have the same cost
+        for (auto f = i; f < files.size(); f += workerCount)
+        {
+            os << files[f] << '\n';
+        }
+    }
+
+    for (auto &worker : workers)
+    {
+        char const *args[] = { executable.c_str(), workerOption, absoluteDirectory.c_str(), worker.fileList.c_str(), worker.index.c_str(), nullptr };
+        bool failed = false;
+        worker.process = llvm::sys::ExecuteNoWait(executable, args, nullptr, nullptr, 0, &error, &failed);
+        if (failed)
+        {
+            error = "Cannot run " + executable + ": " + error;
+            break;
+        }
+    }
+    // Even after a failure, the workers already started must be waited for before their files are removed
+    XRefTable result;
+    for (auto &worker : workers)
+    {
+        if (worker.process.Pid == 0)
+        {
+            continue;
+        }
+        std::string waitError;
+        auto status = llvm::sys::Wait(worker.process, 0, true, &waitError);
+        if (!error.empty())
+        {
+            continue;
+        }
+        XRefIndex part;
+        if (status.ReturnCode != 0 || !part.open(worker.index.str()))
+        {
+            error = "A worker failed to index the project" + (waitError.empty() ? std::string() : ": " + waitError);
+            continue;
+        }
+        part.addTo(result);
+    }
+    removeFiles();
+    if (!error.empty())
+    {
+        return false;
+    }
+    if (!result.save(absoluteIndexFile.str()))
+    {
+        error = "Cannot write " + indexFile;
+        return false;
+    }
+    return true;
+}
+
+bool runXRefWorker(int argc, char **argv, int &exitCode)
+{
+    if (argc != 5 || std::strcmp(argv[1], workerOption) != 0)
+    {
+        return false;
+    }
+    exitCode = 1;
+    std::string error;
+    auto database = tooling::CompilationDatabase::loadFromDirectory(argv[2], error);
+    auto fileList = llvm::MemoryBuffer::getFile(argv[3]);
+    if (database == nullptr || !fileList)
+    {
+        return true;
+    }
+    llvm::SmallVector<llvm::StringRef, 64> lines;
+    (*fileList)->getBuffer().split(lines, '\n', -1, false);
+    std::vector<std::string> files(lines.begin(), lines.end());
+    // ClangTool changes the current directory for each compile command, which is why this runs in its own process
+    XRefTable result;
+    IgnoringDiagConsumer diagnostics;
+    XRefActionFactory factory(result);
+    tooling::ClangTool tool(*database, files);
+    tool.setDiagnosticConsumer(&diagnostics);
+    tool.run(&factory);
+    if (result.save(argv[4]))
+    {
+        exitCode = 0;
+    }
+    return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/ASTContext.h>
+#include <llvm/Support/MemoryBuffer.h>
+#pragma warning (pop)
+
+// Cross references link the declarations, definitions and uses of a symbol, identified by its USR, which
+// is the same in all translation units.
+
+struct XRefOccurrence
+{
+    enum Kind : uint32_t
+    {
+        Declaration = 1 << 0,
+        Definition = 1 << 1,
+        Reference = 1 << 2
+    };
+    std::string file;
+    uint32_t offset;
+    uint32_t line;
+    uint32_t column;
+    uint32_t kind;
+};
+
+// Occurrences of one or several translation units, in memory
+class XRefTable
+{
+public:
+    void add(std::string const &usr, std::string const &file, uint32_t offset, uint32_t line, uint32_t column, uint32_t kind);
+    void merge(XRefTable const &other);
+    std::vector<XRefOccurrence> find(std::string const &usr) const;
+    bool save(std::string const &fileName) const; // See XRefIndex
+    struct Entry
+    {
+        uint32_t file; // Index in myFiles
+        uint32_t offset;
+        uint32_t line;
+        uint32_t column;
+        uint32_t kind;
+    };
+private:
+    uint32_t getFileIndex(std::string const &file);
+    std::vector<std::string> myFiles;
+    std::unordered_map<std::string, uint32_t> myFileIndices;
+    std::unordered_map<std::string, std::vector<Entry>> myEntries; // By USR
+};
+
+// Visits the whole translation unit, template instantiations and implicit code excluded
+void collectXRefs(clang::ASTContext &context, XRefTable &table);
+bool getUsr(clang::Decl const *decl, std::string &usr); // Return false for declarations without USR (local entities...)
+
+// An index saved on disk: Symbols sorted by USR, each pointing to a contiguous range of occurrences, followed by
+// the string table. The file is memory mapped, and looking a symbol up is a binary search.
+class XRefIndex
+{
+public:
+    bool open(std::string const &fileName); // Return false if the file is not a valid index
+    bool isOpen() const;
+    std::vector<XRefOccurrence> find(std::string const &usr) const;
+    void addTo(XRefTable &table) const; // All the occurrences, to merge several indexes
+private:
+    std::unique_ptr<llvm::MemoryBuffer> myBuffer;
+};
+
+// Parses all the files of the compilation database found in directory (compile_commands.json), and saves the
+// index of all of them in indexFile. ClangTool changes the current directory of the process it runs in, so the files
+// are parsed by worker processes, one per core, each running executable (the viewer itself) with the worker command
+// line. Meant to run in a background thread, it does not touch the state of the calling process.
+bool buildXRefIndex(std::string const &directory, std::string const &indexFile, std::string const &executable, std::string &error);
+// To call first thing in main: Return false if the command line is not the one of a worker, otherwise run the worker
+// and set the exit code of the process
+bool runXRefWorker(int argc, char **argv, int &exitCode);
@@ -0,0 +1,202 @@
+#include "FunctionWeights.h"
+#include "AstReader.h"
+#include <unordered_set>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/DeclTemplate.h>
+#include <clang/AST/ExprCXX.h>
+#include <clang/Analysis/CFG.h>
+#pragma warning (pop)
+
+using namespace clang;
+
+namespace
+{
+
+unsigned countCfgBlocks(FunctionDecl const *function, ASTContext &context)
+{
+    if (function->isDependentContext())
+    {
+        return 0;
+    }
+    try
+    {
+        auto cfg = CFG::buildCFG(function, function->getBody(), &context, getCFGBuildOptions());
+        return cfg ? cfg->size() : 0;
+    }
+    catch (std::exception &)
+    {
+        return 0;
+    }
+}
+
+class WeightCollector
+{
+public:
+    WeightCollector(ASTContext &context) : myContext(context), myManager(context.getSourceManager())
+    {
+    }
+
+    // Without recursion, since the tree can be as deep as the code is nested
+    void visit(GenericAstNode *root)
+    {
+        std::vector<std::pair<GenericAstNode *, bool>> toVisit{ { root, false } }; // True once the subtree of a function has been visited
+        unsigned visitedNodes = 0;
+        while (!toVisit.empty())
+        {
+            auto node = toVisit.back().first;
+            auto isFunctionEnd = toVisit.back().second;
+            toVisit.pop_back();
+            if (isFunctionEnd)
+            {
+                auto &weight = myWeights[myOpenFunctions.back().index];
+                weight.nodes = visitedNodes - myOpenFunctions.back().firstNode;
+                weight.instantiations = static_cast<unsigned>(myOpenFunctions.back().instantiations.size());
+                myOpenFunctions.pop_back();
+                continue;
+            }
+            auto function = getFunctionDefinition(node);
+            if (function != nullptr)
+            {
+                myOpenFunctions.push_back(OpenFunction{ myWeights.size(), visitedNodes, {} });
+                myWeights.push_back(FunctionWeight{ node, myManager.getExpansionLineNumber(function->getLocation()), 0, 0, countCfgBlocks(function, myContext), 0 });
+                toVisit.emplace_back(node, true);
+            }
+            else if (!myOpenFunctions.empty())
+            {
+                if (auto decl = boost::get<Decl *>(&node->myAstNode))
+                {
+                    recordDecl(*decl);
+                }
+                else if (auto stmt = boost::get<Stmt *>(&node->myAstNode))
+                {
+                    recordStmt(*stmt);
+                }
+            }
+            ++visitedNodes;
+            for (auto it = node->myChidren.rbegin(); it != node->myChidren.rend(); ++it)
+            {
+                toVisit.emplace_back(it->get(), false);
+            }
+        }
+    }
+
+    std::vector<FunctionWeight> &weights()
+    {
+        return myWeights;
+    }
+
+private:
+    struct OpenFunction
+    {
+        size_t index; // In myWeights
+        unsigned firstNode; // Number of nodes visited before the function, to count the nodes of its subtree
+        std::unordered_set<Decl const *> instantiations;
+    };
+
+    FunctionDecl const *getFunctionDefinition(GenericAstNode *node)
+    {
+        auto decl = boost::get<Decl *>(&node->myAstNode);
+        auto function = decl != nullptr ? dyn_cast_or_null<FunctionDecl>(*decl) : nullptr;
+        if (function == nullptr || !function->doesThisDeclarationHaveABody() || function->getBody() == nullptr)
+        {
+            return nullptr;
+        }
+        return myManager.isInMainFile(myManager.getExpansionLoc(function->getLocation())) ? function : nullptr;
+    }
+
+    // Used functions and types count for all the enclosing functions (a lambda in a function...)
+    void addInstantiation(Decl const *decl)
+    {
+        for (auto &function : myOpenFunctions)
+        {
+            function.instantiations.insert(decl->getCanonicalDecl());
+        }
+    }
+
+    void recordType(QualType type)
+    {
+        if (type.isNull())
+        {
+            return;
+        }
+        auto specialization = dyn_cast_or_null<ClassTemplateSpecializationDecl>(type->getAsCXXRecordDecl());
+        if (specialization != nullptr && isTemplateInstantiation(specialization->getSpecializationKind()))
+        {
+            addInstantiation(specialization);
+        }
+    }
+
+    void recordReferencedDecl(Decl const *decl)
+    {
+        if (auto function = dyn_cast_or_null<FunctionDecl>(decl))
+        {
+            // Also true for the members of class template instantiations
+            if (function->isTemplateInstantiation())
+            {
+                addInstantiation(function);
+            }
+        }
+        else if (auto variable = dyn_cast_or_null<VarTemplateSpecializationDecl>(decl))
+        {
+            if (isTemplateInstantiation(variable->getSpecializationKind()))
+            {
+                addInstantiation(variable);
+            }
+        }
+    }
+
+    void recordDecl(Decl const *decl)
+    {
+        if (auto value = dyn_cast_or_null<ValueDecl>(decl))
+        {
+            recordType(value->getType());
+        }
+    }
+
+    void recordStmt(Stmt const *stmt)
+    {
+        if (isa<LambdaExpr>(stmt))
+        {
+            for (auto &function : myOpenFunctions)
+            {
+                ++myWeights[function.index].lambdas;
+            }
+        }
+        if (auto ref = dyn_cast<DeclRefExpr>(stmt))
+        {
+            recordReferencedDecl(ref->getDecl());
+        }
+        else if (auto member = dyn_cast<MemberExpr>(stmt))
+        {
+            recordReferencedDecl(member->getMemberDecl());
+        }
+        else if (auto construct = dyn_cast<CXXConstructExpr>(stmt))
+        {
+            recordReferencedDecl(construct->getConstructor());
+        }
+        if (auto expr = dyn_cast<Expr>(stmt))
+        {
+            if (!expr->isTypeDependent())
+            {
+                recordType(expr->getType());
+            }
+        }
+    }
+
+    ASTContext &myContext;
+    SourceManager &myManager;
+    std::vector<OpenFunction> myOpenFunctions; // Functions can be nested (lambdas, local classes)
+    std::vector<FunctionWeight> myWeights;
+};
+
+} // namespace
+
+
+std::vector<FunctionWeight> computeFunctionWeights(GenericAstNode *root, ASTContext &context)
+{
+    WeightCollector collector(context);
+    collector.visit(root);
+    return std::move(collector.weights());
+}
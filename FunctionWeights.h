@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/ASTContext.h>
+#pragma warning (pop)
+
+class GenericAstNode;
+
+// What makes a function expensive to compile, or hard to optimize
+struct FunctionWeight
+{
+    GenericAstNode *node;
+    unsigned line;
+    unsigned nodes; // In the subtree of the function
+    unsigned instantiations; // Distinct function and class template instantiations used in the body
+    unsigned cfgBlocks; // 0 for dependent code, that has no meaningful control flow graph
+    unsigned lambdas; // Including the nested ones
+};
+
+// One pass over the tree, for all the function definitions located in the main file (including the instantiations
+// of templates defined there). Does not modify the tree nor the AST, and can run in a background thread as long as
+// nothing else uses clang meanwhile.
+std::vector<FunctionWeight> computeFunctionWeights(GenericAstNode *root, clang::ASTContext &context);
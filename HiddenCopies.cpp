@@ -0,0 +1,159 @@
+#include "HiddenCopies.h"
+#include "AstReader.h"
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/ExprCXX.h>
+#include <clang/AST/StmtCXX.h>
+#pragma warning (pop)
+
+using namespace clang;
+
+namespace
+{
+
+Stmt const *getStmt(GenericAstNode const *node)
+{
+    auto stmt = boost::get<Stmt *>(&node->myAstNode);
+    return stmt != nullptr ? *stmt : nullptr;
+}
+
+Decl const *getDecl(GenericAstNode const *node)
+{
+    auto decl = boost::get<Decl *>(&node->myAstNode);
+    return decl != nullptr ? *decl : nullptr;
+}
+
+// The first parent that is not an implicit wrapper around the copy
+GenericAstNode const *getSignificantParent(GenericAstNode const *node)
+{
+    auto parent = node->myParent;
+    while (parent != nullptr)
+    {
+        auto stmt = getStmt(parent);
+        if (stmt == nullptr || !(isa<ImplicitCastExpr>(stmt) || isa<MaterializeTemporaryExpr>(stmt) || isa<CXXBindTemporaryExpr>(stmt) ||
+            isa<ExprWithCleanups>(stmt) || isa<ParenExpr>(stmt)))
+        {
+            return parent;
+        }
+        parent = parent->myParent;
+    }
+    return nullptr;
+}
+
+std::string classifyCopy(GenericAstNode const *node)
+{
+    auto parent = getSignificantParent(node);
+    if (parent == nullptr)
+    {
+        return "Copy";
+    }
+    if (auto stmt = getStmt(parent))
+    {
+        if (isa<CallExpr>(stmt) || isa<CXXConstructExpr>(stmt))
+        {
+            return "By-value argument";
+        }
+        if (auto returnStmt = dyn_cast<ReturnStmt>(stmt))
+        {
+            return returnStmt->getNRVOCandidate() == nullptr ? "Return (no NRVO)" : "Return";
+        }
+        if (isa<LambdaExpr>(stmt))
+        {
+            return "Lambda capture";
+        }
+        if (isa<InitListExpr>(stmt))
+        {
+            return "Initializer list element";
+        }
+        if (isa<CXXThrowExpr>(stmt))
+        {
+            return "Throw";
+        }
+        return "Copy";
+    }
+    if (auto variable = dyn_cast_or_null<VarDecl>(getDecl(parent)))
+    {
+        // The loop variable is in a DeclStmt, the range-for statement is above it
+        auto ancestor = parent->myParent;
+        if (ancestor != nullptr && getStmt(ancestor) != nullptr && isa<DeclStmt>(getStmt(ancestor)))
+        {
+            ancestor = ancestor->myParent;
+        }
+        auto forRange = ancestor != nullptr ? dyn_cast_or_null<CXXForRangeStmt>(getStmt(ancestor)) : nullptr;
+        if (forRange != nullptr && forRange->getLoopVariable() == variable)
+        {
+            return "Range-for variable";
+        }
+        return isa<ParmVarDecl>(variable) ? "Default argument" : "Variable initialization";
+    }
+    auto decl = getDecl(parent);
+    if (decl != nullptr && (isa<FieldDecl>(decl) || isa<CXXConstructorDecl>(decl)))
+    {
+        return "Member initialization"; // In the class definition, or in a constructor initializer list
+    }
+    return "Copy";
+}
+
+// The copied type, or a null type if the node is not a copy
+QualType getCopiedType(Stmt const *stmt, ASTContext &context)
+{
+    if (auto construct = dyn_cast<CXXConstructExpr>(stmt))
+    {
+        if (construct->getConstructor()->isCopyConstructor() && !construct->isElidable())
+        {
+            return construct->getType();
+        }
+    }
+    else if (auto call = dyn_cast<CXXOperatorCallExpr>(stmt))
+    {
+        auto method = dyn_cast_or_null<CXXMethodDecl>(call->getDirectCallee());
+        if (call->getOperator() == OO_Equal && method != nullptr && method->isCopyAssignmentOperator())
+        {
+            return context.getRecordType(method->getParent());
+        }
+    }
+    return QualType();
+}
+
+} // namespace
+
+
+std::vector<HiddenCopy> findHiddenCopies(GenericAstNode *root, ASTContext &context, uint64_t minSize)
+{
+    auto &manager = context.getSourceManager();
+    std::vector<HiddenCopy> result;
+    std::vector<GenericAstNode *> toVisit{ root };
+    while (!toVisit.empty())
+    {
+        auto node = toVisit.back();
+        toVisit.pop_back();
+        for (auto &child : node->myChidren)
+        {
+            toVisit.push_back(child.get());
+        }
+        auto stmt = getStmt(node);
+        if (stmt == nullptr)
+        {
+            continue;
+        }
+        auto type = getCopiedType(stmt, context);
+        if (type.isNull() || type->isDependentType() || type->isIncompleteType() || type.isTriviallyCopyableType(context))
+        {
+            continue;
+        }
+        auto location = manager.getExpansionLoc(stmt->getLocStart());
+        if (!manager.isInMainFile(location))
+        {
+            continue;
+        }
+        uint64_t size = context.getTypeSizeInChars(type).getQuantity();
+        if (size < minSize)
+        {
+            continue;
+        }
+        result.push_back(HiddenCopy{ node, classifyCopy(node), type.getAsString(), size,
+            std::to_string(manager.getExpansionLineNumber(location)) + ":" + std::to_string(manager.getExpansionColumnNumber(location)) });
+    }
+    return result;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/ASTContext.h>
+#pragma warning (pop)
+
+class GenericAstNode;
+
+// A copy construction or copy assignment of a type that is not trivially copyable
+struct HiddenCopy
+{
+    GenericAstNode *node; // The CXXConstructExpr or CXXOperatorCallExpr
+    std::string kind; // By-value argument, range-for variable, return...
+    std::string type;
+    uint64_t size; // sizeof the type, in bytes. What is copied may be much bigger (heap allocated content)
+    std::string position; // line:column
+};
+
+// Only the copies located in the main file are reported. Copies the compiler may elide are not reported.
+// The tree must contain the implicit code, and be attached to a live AST.
+std::vector<HiddenCopy> findHiddenCopies(GenericAstNode *root, clang::ASTContext &context, uint64_t minSize);
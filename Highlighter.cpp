@@ -39,6 +39,7 @@
 ****************************************************************************/
 
 #include "highlighter.h"
+#include "Trace.h"
 
 //! [0]
 Highlighter::Highlighter(QTextDocument *parent)
@@ -106,6 +107,7 @@ Highlighter::Highlighter(QTextDocument *parent)
 //! [7]
 void Highlighter::highlightBlock(const QString &text)
 {
+    TRACE_FREQUENT_SCOPE("Highlighter::highlightBlock");
     foreach (const HighlightingRule &rule, highlightingRules) {
         QRegExp expression(rule.pattern);
         int index = expression.indexIn(text);
@@ -0,0 +1,54 @@
+#include "InMemoryCompiler.h"
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/CodeGen/CodeGenAction.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/Utils.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#pragma warning (pop)
+
+namespace
+{
+
+char const mainFileName[] = "input.cc";
+
+} // namespace
+
+
+std::unique_ptr<llvm::Module> compileInMemory(std::string const &sourceCode, std::vector<std::string> const &args,
+    std::vector<char const *> const &extraArgs, clang::DiagnosticConsumer &diagnostics, llvm::LLVMContext &context, std::string &error)
+{
+    std::vector<char const *> commandLine{ "clang-tool", "-c" };
+    commandLine.insert(commandLine.end(), extraArgs.begin(), extraArgs.end());
+    for (auto &arg : args)
+    {
+        commandLine.push_back(arg.c_str());
+    }
+    commandLine.push_back(mainFileName);
+    llvm::IntrusiveRefCntPtr<clang::CompilerInvocation> invocation = clang::createInvocationFromCommandLine(commandLine);
+    if (invocation == nullptr)
+    {
+        error = "The command line is not valid";
+        return nullptr;
+    }
+    // The compiler instance takes ownership of the buffer
+    invocation->getPreprocessorOpts().addRemappedFile(mainFileName, llvm::MemoryBuffer::getMemBufferCopy(sourceCode, mainFileName).release());
+    invocation->getFrontendOpts().DisableFree = false;
+    clang::CompilerInstance compiler;
+    compiler.setInvocation(invocation.get());
+    compiler.createDiagnostics(&diagnostics, false);
+    clang::EmitLLVMOnlyAction action(&context); // Also runs the optimizer, but not the machine code generation
+    std::unique_ptr<llvm::Module> module;
+    if (compiler.ExecuteAction(action))
+    {
+        module = action.takeModule();
+    }
+    if (module == nullptr)
+    {
+        error = "Compilation failed";
+    }
+    return module;
+}
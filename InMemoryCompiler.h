@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace clang
+{
+class DiagnosticConsumer;
+}
+
+namespace llvm
+{
+class LLVMContext;
+class Module;
+}
+
+// Compiles the code of the viewer (which is not saved anywhere) to optimized LLVM IR, with its own compiler
+// instance, so that it can run in a background thread. extraArgs go before args (optimization level, remark
+// flags...). The diagnostics are sent to diagnostics, that is not owned. Return nullptr on failure, with an error
+// that does not include the diagnostics.
+std::unique_ptr<llvm::Module> compileInMemory(std::string const &sourceCode, std::vector<std::string> const &args,
+    std::vector<char const *> const &extraArgs, clang::DiagnosticConsumer &diagnostics, llvm::LLVMContext &context, std::string &error);
@@ -0,0 +1,253 @@
+#include "IncludeProfiler.h"
+#include "AstReader.h"
+#include <sstream>
+#include <algorithm>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/Lex/PPCallbacks.h>
+#include <clang/Lex/Preprocessor.h>
+#include <clang/Lex/Lexer.h>
+#pragma warning (pop)
+
+using namespace clang;
+
+namespace
+{
+
+class IncludeCallbacks : public PPCallbacks
+{
+public:
+    IncludeCallbacks(IncludeProfiler &profiler, CompilerInstance &instance) : myProfiler(profiler), myInstance(instance)
+    {
+    }
+
+    void FileChanged(SourceLocation location, FileChangeReason reason, SrcMgr::CharacteristicKind, FileID) override
+    {
+        // The compiler instance does not exist anymore once the parse is over
+        if (!myProfiler.recording())
+        {
+            return;
+        }
+        auto &manager = myInstance.getSourceManager();
+        if (reason == EnterFile)
+        {
+            auto file = manager.getFileID(location);
+            auto entry = manager.getFileEntryForID(file);
+            auto includeLocation = manager.getIncludeLoc(file);
+            myProfiler.enterFile(file,
+                entry != nullptr ? std::string(entry->getName()) : manager.getBufferName(location).str(), // <built-in>...
+                includeLocation.isValid() ? manager.getSpellingLineNumber(includeLocation) : 0,
+                allocatedBytes());
+        }
+        else if (reason == ExitFile)
+        {
+            myProfiler.exitFile(allocatedBytes());
+        }
+    }
+
+    void EndOfMainFile() override
+    {
+        if (myProfiler.recording())
+        {
+            myProfiler.endOfMainFile(allocatedBytes());
+        }
+    }
+
+private:
+    uint64_t allocatedBytes()
+    {
+        // The context is created after the preprocessor
+        return myInstance.hasASTContext() ? myInstance.getASTContext().getASTAllocatedMemory() : 0;
+    }
+
+    IncludeProfiler &myProfiler;
+    CompilerInstance &myInstance;
+};
+
+unsigned countTokens(SourceManager &manager, FileID file, LangOptions const &langOptions)
+{
+    bool invalid = false;
+    auto buffer = manager.getBuffer(file, &invalid);
+    if (invalid)
+    {
+        return 0;
+    }
+    Lexer lexer(manager.getLocForStartOfFile(file), langOptions, buffer->getBufferStart(), buffer->getBufferStart(), buffer->getBufferEnd());
+    unsigned count = 0;
+    Token token;
+    while (true)
+    {
+        lexer.LexFromRawLexer(token);
+        if (token.is(tok::eof))
+        {
+            return count;
+        }
+        ++count;
+    }
+}
+
+// Post order, computes inclusive node counts and self costs
+void computeTotals(IncludeProfileNode &node)
+{
+    node.inclusiveNodes = node.selfNodes;
+    node.selfSeconds = node.inclusiveSeconds;
+    node.selfBytes = node.inclusiveBytes;
+    for (auto &child : node.children)
+    {
+        computeTotals(*child);
+        node.inclusiveNodes += child->inclusiveNodes;
+        node.selfSeconds -= child->inclusiveSeconds;
+        node.selfBytes -= std::min(node.selfBytes, child->inclusiveBytes);
+    }
+}
+
+std::string escapeJson(std::string const &s)
+{
+    std::string result;
+    for (auto c : s)
+    {
+        switch (c)
+        {
+        case '"': result += "\\\""; break;
+        case '\\': result += "\\\\"; break;
+        case '\n': result += "\\n"; break;
+        case '\t': result += "\\t"; break;
+        default: result += c;
+        }
+    }
+    return result;
+}
+
+void writeJson(std::ostream &os, IncludeProfileNode const &node)
+{
+    os << "{\"file\":\"" << escapeJson(node.file) << "\""
+        << ",\"includeLine\":" << node.includeLine
+        << ",\"inclusiveSeconds\":" << node.inclusiveSeconds
+        << ",\"selfSeconds\":" << node.selfSeconds
+        << ",\"tokens\":" << node.tokens
+        << ",\"inclusiveBytes\":" << node.inclusiveBytes
+        << ",\"selfBytes\":" << node.selfBytes
+        << ",\"inclusiveNodes\":" << node.inclusiveNodes
+        << ",\"selfNodes\":" << node.selfNodes
+        << ",\"children\":[";
+    bool first = true;
+    for (auto &child : node.children)
+    {
+        if (!first)
+        {
+            os << ",";
+        }
+        first = false;
+        writeJson(os, *child);
+    }
+    os << "]}";
+}
+
+} // namespace
+
+
+void IncludeProfiler::install(CompilerInstance &instance)
+{
+    myRoot = std::make_unique<IncludeProfileNode>();
+    *myRoot = IncludeProfileNode{ "", 0, 0, 0, 0, 0, 0, 0, 0, nullptr, {} };
+    myOpenFiles.clear();
+    myFiles.clear();
+    myNodesByFile.clear();
+    myIsRecording = true;
+    instance.getPreprocessor().addPPCallbacks(std::make_unique<IncludeCallbacks>(*this, instance));
+}
+
+bool IncludeProfiler::recording() const
+{
+    return myIsRecording;
+}
+
+void IncludeProfiler::enterFile(FileID file, std::string const &name, unsigned includeLine, uint64_t allocatedBytes)
+{
+    auto parent = myOpenFiles.empty() ? myRoot.get() : myOpenFiles.back().node;
+    parent->children.push_back(std::make_unique<IncludeProfileNode>());
+    auto node = parent->children.back().get();
+    *node = IncludeProfileNode{ name, includeLine, 0, 0, 0, 0, 0, 0, 0, parent, {} };
+    myFiles.emplace_back(file, node);
+    myNodesByFile[file.getHashValue()] = node;
+    myOpenFiles.push_back(OpenFile{ node, std::chrono::steady_clock::now(), allocatedBytes });
+}
+
+void IncludeProfiler::exitFile(uint64_t allocatedBytes)
+{
+    if (myOpenFiles.empty())
+    {
+        return;
+    }
+    auto &file = myOpenFiles.back();
+    file.node->inclusiveSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - file.start).count();
+    file.node->inclusiveBytes = allocatedBytes - file.startBytes;
+    myOpenFiles.pop_back();
+}
+
+void IncludeProfiler::endOfMainFile(uint64_t allocatedBytes)
+{
+    while (!myOpenFiles.empty())
+    {
+        exitFile(allocatedBytes);
+    }
+    myIsRecording = false;
+}
+
+void IncludeProfiler::finish(GenericAstNode *artificialRoot, ASTContext &context)
+{
+    if (myRoot == nullptr)
+    {
+        return;
+    }
+    // The parse may have stopped before the end of the main file (fatal error)
+    if (myIsRecording)
+    {
+        endOfMainFile(context.getASTAllocatedMemory());
+    }
+    auto &manager = context.getSourceManager();
+
+    std::vector<GenericAstNode *> toVisit{ artificialRoot };
+    while (!toVisit.empty())
+    {
+        auto node = toVisit.back();
+        toVisit.pop_back();
+        auto range = node->getRange();
+        if (range.isValid())
+        {
+            auto file = myNodesByFile.find(manager.getFileID(manager.getExpansionLoc(range.getBegin())).getHashValue());
+            if (file != myNodesByFile.end())
+            {
+                ++file->second->selfNodes;
+            }
+        }
+        for (auto &child : node->myChidren)
+        {
+            toVisit.push_back(child.get());
+        }
+    }
+    // Counted after the parse, so that it does not distort the measured times
+    for (auto &file : myFiles)
+    {
+        file.second->tokens = countTokens(manager, file.first, context.getLangOpts());
+    }
+    for (auto &child : myRoot->children)
+    {
+        myRoot->inclusiveSeconds += child->inclusiveSeconds;
+        myRoot->inclusiveBytes += child->inclusiveBytes;
+    }
+    computeTotals(*myRoot);
+}
+
+IncludeProfileNode const *IncludeProfiler::root() const
+{
+    return myRoot.get();
+}
+
+std::string includeProfileToJson(IncludeProfileNode const &root)
+{
+    std::ostringstream os;
+    writeJson(os, root);
+    return os.str();
+}
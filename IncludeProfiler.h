@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <chrono>
+#include <unordered_map>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/Frontend/CompilerInstance.h>
+#pragma warning (pop)
+
+class GenericAstNode;
+
+// One file entered during the parse. A header included several times (without include guard) has several nodes.
+// Self costs are what is not accounted for by the included files.
+struct IncludeProfileNode
+{
+    std::string file;
+    unsigned includeLine; // In the parent file
+    double inclusiveSeconds;
+    double selfSeconds;
+    unsigned tokens; // Raw tokens of the file itself
+    uint64_t inclusiveBytes; // Memory allocated by the ASTContext while the file was parsed
+    uint64_t selfBytes;
+    unsigned inclusiveNodes; // GenericAstNode created for declarations and statements located in the file
+    unsigned selfNodes;
+    IncludeProfileNode *parent;
+    std::vector<std::unique_ptr<IncludeProfileNode>> children;
+};
+
+// Records the include tree of a parse through PPCallbacks, with the wall time spent in each file (including
+// the parsing of what it contains, since the parser drives the preprocessor).
+class IncludeProfiler
+{
+public:
+    void install(clang::CompilerInstance &instance); // Before the parse starts
+    // After the tree is built: Attributes its nodes to files, counts tokens and computes the self costs
+    void finish(GenericAstNode *artificialRoot, clang::ASTContext &context);
+    IncludeProfileNode const *root() const; // nullptr if nothing was recorded
+    // Called by the PPCallbacks, that outlive the parse
+    bool recording() const;
+    void enterFile(clang::FileID file, std::string const &name, unsigned includeLine, uint64_t allocatedBytes);
+    void exitFile(uint64_t allocatedBytes);
+    void endOfMainFile(uint64_t allocatedBytes);
+private:
+    struct OpenFile
+    {
+        IncludeProfileNode *node;
+        std::chrono::steady_clock::time_point start;
+        uint64_t startBytes;
+    };
+    std::unique_ptr<IncludeProfileNode> myRoot; // Artificial, holds the predefines buffer and the main file
+    bool myIsRecording = false;
+    std::vector<OpenFile> myOpenFiles;
+    std::vector<std::pair<clang::FileID, IncludeProfileNode *>> myFiles;
+    std::unordered_map<unsigned, IncludeProfileNode *> myNodesByFile; // By FileID hash value
+};
+
+std::string includeProfileToJson(IncludeProfileNode const &root); // For external dashboards
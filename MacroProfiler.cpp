@@ -0,0 +1,237 @@
+#include "MacroProfiler.h"
+#include "AstReader.h"
+#include <algorithm>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/Lex/PPCallbacks.h>
+#include <clang/Lex/Preprocessor.h>
+#include <clang/Lex/MacroInfo.h>
+#include <clang/Lex/MacroArgs.h>
+#pragma warning (pop)
+
+using namespace clang;
+
+namespace
+{
+
+unsigned countExpandedTokens(MacroInfo const &macro, MacroArgs const *args)
+{
+    if (macro.isBuiltinMacro())
+    {
+        return 1; // __LINE__, __FILE__...
+    }
+    unsigned count = 0;
+    for (unsigned i = 0; i < macro.getNumTokens(); ++i)
+    {
+        auto &token = macro.getReplacementToken(i);
+        if (token.is(tok::hashhash))
+        {
+            // The two operands are pasted into one token
+            if (count > 0)
+            {
+                --count;
+            }
+            continue;
+        }
+        if (token.is(tok::hash) && macro.isFunctionLike() && i + 1 < macro.getNumTokens())
+        {
+            // The parameter is stringified into one literal
+            ++count;
+            ++i;
+            continue;
+        }
+        auto identifier = token.getIdentifierInfo();
+        auto argument = identifier != nullptr && args != nullptr ? macro.getArgumentNum(identifier) : -1;
+        if (argument >= 0)
+        {
+            count += MacroArgs::getArgLength(args->getUnexpArgument(argument));
+        }
+        else
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+std::string formatLocation(SourceManager &manager, SourceLocation location, bool withColumn)
+{
+    auto presumed = manager.getPresumedLoc(location);
+    if (presumed.isInvalid())
+    {
+        return "";
+    }
+    auto result = std::string(presumed.getFilename()) + ":" + std::to_string(presumed.getLine());
+    if (withColumn)
+    {
+        result += ":" + std::to_string(presumed.getColumn());
+    }
+    return result;
+}
+
+class MacroCallbacks : public PPCallbacks
+{
+public:
+    MacroCallbacks(MacroProfiler &profiler, CompilerInstance &instance) : myProfiler(profiler), myInstance(instance)
+    {
+    }
+
+    void MacroExpands(Token const &nameToken, MacroDefinition const &definition, SourceRange, MacroArgs const *args) override
+    {
+        // The compiler instance does not exist anymore once the parse is over
+        auto macro = definition.getMacroInfo();
+        if (!myProfiler.recording() || macro == nullptr)
+        {
+            return;
+        }
+        auto &manager = myInstance.getSourceManager();
+        unsigned depth = 0;
+        for (auto location = nameToken.getLocation(); location.isMacroID(); location = manager.getImmediateMacroCallerLoc(location))
+        {
+            ++depth;
+        }
+        auto name = nameToken.getIdentifierInfo();
+        myProfiler.macroExpanded(macro,
+            name != nullptr ? name->getName().str() : "",
+            macro->isBuiltinMacro() ? "<built-in>" : formatLocation(manager, macro->getDefinitionLoc(), false),
+            manager.getExpansionLoc(nameToken.getLocation()),
+            countExpandedTokens(*macro, args),
+            depth);
+    }
+
+    void EndOfMainFile() override
+    {
+        if (myProfiler.recording())
+        {
+            myProfiler.endOfMainFile();
+        }
+    }
+
+private:
+    MacroProfiler &myProfiler;
+    CompilerInstance &myInstance;
+};
+
+struct SiteOffset
+{
+    unsigned offset;
+    MacroExpansionSite *site;
+    bool operator<(SiteOffset const &other) const
+    {
+        return offset < other.offset;
+    }
+};
+
+} // namespace
+
+
+void MacroProfiler::install(CompilerInstance &instance)
+{
+    myEntries.clear();
+    myEntriesByMacro.clear();
+    myHasProfile = true;
+    myIsRecording = true;
+    instance.getPreprocessor().addPPCallbacks(std::make_unique<MacroCallbacks>(*this, instance));
+}
+
+bool MacroProfiler::recording() const
+{
+    return myIsRecording;
+}
+
+void MacroProfiler::macroExpanded(MacroInfo const *macro, std::string const &name, std::string const &definition,
+    SourceLocation location, unsigned tokens, unsigned depth)
+{
+    auto index = myEntriesByMacro.find(macro);
+    if (index == myEntriesByMacro.end())
+    {
+        index = myEntriesByMacro.emplace(macro, myEntries.size()).first;
+        myEntries.push_back(MacroProfileEntry{ name, definition, 0, 0, 0, 0, {} });
+    }
+    auto &entry = myEntries[index->second];
+    ++entry.expansions;
+    entry.expandedTokens += tokens;
+    if (depth > 0)
+    {
+        ++entry.nestedExpansions;
+    }
+    entry.maxDepth = std::max(entry.maxDepth, depth);
+    if (entry.sites.size() < maxSitesPerMacro)
+    {
+        entry.sites.push_back(MacroExpansionSite{ location, "", tokens, depth, nullptr });
+    }
+}
+
+void MacroProfiler::endOfMainFile()
+{
+    myIsRecording = false;
+}
+
+void MacroProfiler::finish(GenericAstNode *artificialRoot, SourceManager &manager)
+{
+    if (!myHasProfile)
+    {
+        return;
+    }
+    myIsRecording = false;
+    myEntriesByMacro.clear(); // The MacroInfo may be released with the AST
+
+    std::unordered_map<unsigned, std::vector<SiteOffset>> sitesByFile; // By FileID hash value
+    for (auto &entry : myEntries)
+    {
+        for (auto &site : entry.sites)
+        {
+            site.position = formatLocation(manager, site.location, true);
+            auto decomposed = manager.getDecomposedLoc(site.location);
+            sitesByFile[decomposed.first.getHashValue()].push_back(SiteOffset{ decomposed.second, &site });
+        }
+    }
+    for (auto &sites : sitesByFile)
+    {
+        std::sort(sites.second.begin(), sites.second.end());
+    }
+
+    // Parents are visited before their children, so the deepest node containing a site is the last one linked to it
+    std::vector<GenericAstNode *> toVisit{ artificialRoot };
+    while (!toVisit.empty())
+    {
+        auto node = toVisit.back();
+        toVisit.pop_back();
+        for (auto &child : node->myChidren)
+        {
+            toVisit.push_back(child.get());
+        }
+        auto range = node->getRange();
+        if (range.isInvalid())
+        {
+            continue;
+        }
+        auto begin = manager.getDecomposedLoc(manager.getExpansionLoc(range.getBegin()));
+        auto end = manager.getDecomposedLoc(manager.getExpansionLoc(range.getEnd()));
+        if (begin.first != end.first)
+        {
+            continue;
+        }
+        auto sites = sitesByFile.find(begin.first.getHashValue());
+        if (sites == sitesByFile.end())
+        {
+            continue;
+        }
+        for (auto site = std::lower_bound(sites->second.begin(), sites->second.end(), SiteOffset{ begin.second, nullptr });
+            site != sites->second.end() && site->offset <= end.second; ++site)
+        {
+            site->site->node = node;
+        }
+    }
+
+    std::stable_sort(myEntries.begin(), myEntries.end(), [](MacroProfileEntry const &e1, MacroProfileEntry const &e2)
+    {
+        return e1.expandedTokens > e2.expandedTokens;
+    });
+}
+
+std::vector<MacroProfileEntry> const *MacroProfiler::entries() const
+{
+    return myHasProfile ? &myEntries : nullptr;
+}
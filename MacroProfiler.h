@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/Frontend/CompilerInstance.h>
+#pragma warning (pop)
+
+class GenericAstNode;
+
+struct MacroExpansionSite
+{
+    clang::SourceLocation location; // Expansion location, in a file. Only meaningful while the AST is alive
+    std::string position; // file:line:column
+    unsigned tokens;
+    unsigned depth; // 0 if the macro is used directly in the source, 1 if it is used in the expansion of another macro...
+    GenericAstNode *node; // Deepest node whose range contains the site, nullptr if none (directives, unused declarations...)
+};
+
+// All the expansions of one macro definition. A macro that is redefined has one entry per definition.
+struct MacroProfileEntry
+{
+    std::string name;
+    std::string definition; // file:line
+    unsigned expansions;
+    uint64_t expandedTokens; // Tokens directly produced by the expansions, see MacroProfiler
+    unsigned nestedExpansions; // Expansions with a depth greater than 0
+    unsigned maxDepth;
+    std::vector<MacroExpansionSite> sites; // Only the first ones are kept, see maxSitesPerMacro
+};
+
+// Records the macro expansions of a parse through PPCallbacks::MacroExpands.
+// The expanded tokens of an expansion are the tokens of the macro body, with each parameter replaced by the
+// tokens of its argument, before rescanning. Macros that appear in the result are expanded in turn, and counted
+// for their own definition.
+class MacroProfiler
+{
+public:
+    static size_t const maxSitesPerMacro = 1000;
+    void install(clang::CompilerInstance &instance); // Before the parse starts
+    // After the tree is built: Links the sites to their nodes, and sorts the entries by expanded tokens
+    void finish(GenericAstNode *artificialRoot, clang::SourceManager &manager);
+    std::vector<MacroProfileEntry> const *entries() const; // nullptr if nothing was recorded
+    // Called by the PPCallbacks, that outlive the parse
+    bool recording() const;
+    void macroExpanded(clang::MacroInfo const *macro, std::string const &name, std::string const &definition,
+        clang::SourceLocation location, unsigned tokens, unsigned depth);
+    void endOfMainFile();
+private:
+    bool myIsRecording = false;
+    bool myHasProfile = false;
+    std::vector<MacroProfileEntry> myEntries;
+    std::unordered_map<clang::MacroInfo const *, size_t> myEntriesByMacro; // Index in myEntries, only used while recording
+};
@@ -3,7 +3,44 @@
 #include <qwindow.h>
 #include <qfilesystemmodel.h>
 #include <qstringlist.h>
+#include <qfiledialog.h>
+#include <qinputdialog.h>
+#include <qheaderview.h>
+#include <qapplication.h>
+#include <qbrush.h>
+#include <qtimer.h>
+#include <qfile.h>
+#include <qtabwidget.h>
+#include <future>
+#include <algorithm>
 #include "AstModel.h"
+#include "AstDiff.h"
+#include "CrossReferences.h"
+#include "IncludeProfiler.h"
+#include "Trace.h"
+
+namespace
+{
+int const PathLanguage = 1; // Index in the queryLanguage combo box
+size_t const pathQueryBudget = 20000; // Candidates checked between two refreshes of the UI
+
+size_t countNodes(GenericAstNode *root)
+{
+    size_t nodes = 0;
+    std::vector<GenericAstNode *> toCount{ root };
+    while (!toCount.empty())
+    {
+        auto node = toCount.back();
+        toCount.pop_back();
+        ++nodes;
+        for (auto &child : node->myChidren)
+        {
+            toCount.push_back(child.get());
+        }
+    }
+    return nodes;
+}
+}
 
 class UpdateLock
 {
@@ -21,27 +58,167 @@ public:
 
 MainWindow::MainWindow(QWidget *parent) : 
     QMainWindow(parent),
+    myPathQueryMatches(0),
+    myQueryTimer(nullptr),
+    myWeightsTimer(nullptr),
+    myCodeTimer(nullptr),
+    myRemarksTimer(nullptr),
+    myIndexTimer(nullptr),
+    myBeatTimer(nullptr),
+    myCodeRequestNode(nullptr),
+    myOptimizationLevel("-O2"),
+    myCacheLineSize(64),
+    myHiddenCopyMinSize(16),
     isUpdateInProgress(false)
 {
     myUi.setupUi(this);
 
     connect(myUi.actionRefresh, &QAction::triggered, this, &MainWindow::RefreshAst);
+    connect(myUi.actionInvalidateCache, &QAction::triggered, this, [this]() {myReader.invalidateParseCache(); });
+    connect(myUi.actionModules, &QAction::toggled, this, [this](bool checked) {myReader.setUseModules(checked); });
+    connect(myUi.actionModuleCache, &QAction::triggered, this, &MainWindow::SetModuleCache);
+    connect(myUi.actionDetached, &QAction::toggled, this, &MainWindow::UpdateDetachedMode);
+    connect(myUi.actionPrecomputeCfg, &QAction::toggled, this, &MainWindow::UpdateDetachedMode);
+    connect(myUi.actionSaveSnapshot, &QAction::triggered, this, &MainWindow::SaveSnapshot);
+    connect(myUi.actionOpenSnapshot, &QAction::triggered, this, &MainWindow::OpenSnapshot);
+    connect(myUi.actionCompare, &QAction::triggered, this, &MainWindow::CompareConfigurations);
+    connect(myUi.actionCollapseInstantiations, &QAction::toggled, this, [this](bool checked) {myReader.setCollapseInstantiations(checked); });
+    myReader.setCollapseInstantiations(myUi.actionCollapseInstantiations->isChecked());
+    connect(myUi.actionTemplateBloat, &QAction::triggered, this, &MainWindow::ShowTemplateBloat);
+    connect(myUi.actionProfileIncludes, &QAction::toggled, this, [this](bool checked) {myReader.setProfileIncludes(checked); });
+    connect(myUi.actionIncludeProfile, &QAction::triggered, this, &MainWindow::ShowIncludeProfile);
+    connect(myUi.actionProfileMacros, &QAction::toggled, this, [this](bool checked) {myReader.setProfileMacros(checked); });
+    connect(myUi.actionMacroProfile, &QAction::triggered, this, &MainWindow::ShowMacroProfile);
+    connect(myUi.actionFunctionWeights, &QAction::triggered, this, &MainWindow::ShowFunctionWeights);
+    connect(myUi.actionRecordPadding, &QAction::triggered, this, &MainWindow::ShowRecordPadding);
+    connect(myUi.actionCacheLineSize, &QAction::triggered, this, &MainWindow::SetCacheLineSize);
+    connect(myUi.actionHiddenCopies, &QAction::triggered, this, &MainWindow::ShowHiddenCopies);
+    connect(myUi.actionMoveAudit, &QAction::triggered, this, &MainWindow::ShowMoveAudit);
+    connect(myUi.actionAllocationSites, &QAction::triggered, this, &MainWindow::ShowAllocationSites);
+    connect(myUi.actionVirtualCalls, &QAction::triggered, this, &MainWindow::ShowVirtualCalls);
+    connect(myUi.actionGeneratedCode, &QAction::triggered, this, &MainWindow::ShowGeneratedCode);
+    connect(myUi.actionOptimizationLevel, &QAction::triggered, this, &MainWindow::SetOptimizationLevel);
+    connect(myUi.actionOptimizationRemarks, &QAction::triggered, this, &MainWindow::ShowOptimizationRemarks);
+    connect(myUi.actionRecordTrace, &QAction::toggled, this, [](bool checked) {trace::setRecording(checked); });
+    connect(myUi.actionSaveTrace, &QAction::triggered, this, &MainWindow::SaveTrace);
+    connect(myUi.actionStalls, &QAction::triggered, this, &MainWindow::ShowStalls);
+    connect(myUi.actionStallThreshold, &QAction::triggered, this, &MainWindow::SetStallThreshold);
+    connect(myUi.actionIndexProject, &QAction::triggered, this, &MainWindow::IndexProject);
+    connect(myUi.actionOpenIndex, &QAction::triggered, this, &MainWindow::OpenIndex);
+    connect(myUi.actionGoToDefinition, &QAction::triggered, this, &MainWindow::GoToDefinition);
+    connect(myUi.actionFindReferences, &QAction::triggered, this, &MainWindow::FindAllReferences);
+    connect(myUi.queryInput, &QLineEdit::returnPressed, this, &MainWindow::RunQuery);
+    connect(myUi.queryLanguage, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, [this](int language)
+    {
+        myUi.queryInput->setPlaceholderText(language == PathLanguage ?
+            "Path, for instance: FunctionDecl//DeclRefExpr[Referenced name~=printf]" :
+            "Matcher expression, for instance: callExpr(callee(functionDecl(hasName(\"f\"))))");
+    });
+    myQueryTimer = new QTimer(this);
+    connect(myQueryTimer, &QTimer::timeout, this, &MainWindow::ContinuePathQuery);
+    myWeightsTimer = new QTimer(this);
+    myWeightsTimer->setInterval(100);
+    connect(myWeightsTimer, &QTimer::timeout, this, &MainWindow::CheckFunctionWeights);
+    myCodeTimer = new QTimer(this);
+    myCodeTimer->setInterval(100);
+    connect(myCodeTimer, &QTimer::timeout, this, &MainWindow::CheckGeneratedCode);
+    myRemarksTimer = new QTimer(this);
+    myRemarksTimer->setInterval(100);
+    connect(myRemarksTimer, &QTimer::timeout, this, &MainWindow::CheckOptimizationRemarks);
+    myIndexTimer = new QTimer(this);
+    myIndexTimer->setInterval(100);
+    connect(myIndexTimer, &QTimer::timeout, this, &MainWindow::CheckProjectIndex);
+    // The watchdog thread notices when these beats stop coming
+    myBeatTimer = new QTimer(this);
+    myBeatTimer->setInterval(20);
+    connect(myBeatTimer, &QTimer::timeout, this, [this]() {myWatchdog.beat(); });
+    myBeatTimer->start();
+    myWatchdog.start(200);
+    connect(myUi.queryResults, &QTreeWidget::itemDoubleClicked, this, [this](QTreeWidgetItem *item, int)
+    {
+        SelectNode(item->data(0, Qt::NodeRole).value<GenericAstNode*>());
+    });
+    UpdateDetachedMode();
 
     myHighlighter = new Highlighter(myUi.codeViewer->document());
     myUi.nodeProperties->setHeaderLabels({ "Property", "Value" });
     connect(myUi.codeViewer, &QTextEdit::cursorPositionChanged, this, &MainWindow::HighlightNodeMatchingCode);
     connect(myUi.codeViewer, &QTextEdit::textChanged, this, &MainWindow::OnCodeChange);
     connect(myUi.showDetails, &QPushButton::clicked, this, &MainWindow::ShowNodeDetails);
+    // Loop depths are computed per function, when it is first displayed
+    connect(myUi.astTreeView, &QTreeView::expanded, this, [this](QModelIndex const &index)
+    {
+        StallWatchdog::Activity activity(myWatchdog, "AnnotateLoopDepths");
+        myReader.annotateLoopDepths(myUi.astTreeView->model()->data(index, Qt::NodeRole).value<GenericAstNode*>());
+    });
 }
 
 void MainWindow::RefreshAst()
 {
+    StallWatchdog::Activity activity(myWatchdog, "RefreshAst");
     auto ast = myReader.readAst(myUi.codeViewer->document()->toPlainText().toStdString(),
         myUi.commandLineArgs->document()->toPlainText().toStdString());
-    auto model = new AstModel(std::move(ast));
+    DisplayAst(ast);
+    if (!myReader.getCommandLineError().empty())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in command line", QString::fromStdString(myReader.getCommandLineError()), QMessageBox::Ok);
+    }
+    auto status = QString("%1 file system lookups avoided").arg(myReader.getSavedStatCount());
+    if (myUi.actionModules->isChecked())
+    {
+        int hits = 0;
+        QStringList compiled;
+        for (auto &module : myReader.getLastParseModules())
+        {
+            if (module.hitCache)
+            {
+                ++hits;
+            }
+            else
+            {
+                compiled << QString::fromStdString(module.name);
+            }
+        }
+        status += QString(", %1 modules loaded from the cache").arg(hits);
+        if (!compiled.isEmpty())
+        {
+            status += ", compiled in " + QString::fromStdString(myReader.getModuleCacheDirectory()) + ": " + compiled.join(", ");
+        }
+    }
+    myUi.statusbar->showMessage(status);
+}
+
+void MainWindow::DisplayAst(GenericAstNode *ast)
+{
+    // Reports link to the nodes of the previous tree
+    for (auto win : myReportWindows)
+    {
+        win->close();
+        win->deleteLater();
+    }
+    myReportWindows.clear();
+    myCodeRequestNode = nullptr; // The compilation goes on, its result will still be cached
+    myQueryTimer->stop();
+    myPathQuery.reset();
+    myUi.queryResults->clear();
+    myPathIndex.reset(ast);
+
+    auto model = new AstModel(ast);
 
     myUi.astTreeView->setModel(model);
     myUi.astTreeView->setRootIndex(model->rootIndex());
+    myWatchdog.setTreeSize(countNodes(ast));
+    // Shared type proxies and collapsed instantiations get their children when they are expanded
+    connect(model, &QAbstractItemModel::rowsInserted, this, [this, model](QModelIndex const &parent, int first, int last)
+    {
+        auto parentNode = model->data(parent, Qt::NodeRole).value<GenericAstNode*>();
+        size_t nodes = 0;
+        for (auto row = first; row <= last; ++row)
+        {
+            nodes += countNodes(parentNode->myChidren[row].get());
+        }
+        myWatchdog.addToTreeSize(nodes);
+    });
     connect(myUi.astTreeView->selectionModel(), &QItemSelectionModel::currentChanged,
         this, &MainWindow::HighlightCodeMatchingNode);
     connect(myUi.astTreeView->selectionModel(), &QItemSelectionModel::currentChanged,
@@ -49,17 +226,181 @@ void MainWindow::RefreshAst()
     myUi.astTreeView->setEnabled(myReader.ready());
 }
 
+void MainWindow::UpdateDetachedMode()
+{
+    myUi.actionPrecomputeCfg->setEnabled(myUi.actionDetached->isChecked());
+    myReader.setDetachedMode(myUi.actionDetached->isChecked(), myUi.actionPrecomputeCfg->isChecked());
+}
+
+void MainWindow::SaveSnapshot()
+{
+    StallWatchdog::Activity activity(myWatchdog, "SaveSnapshot");
+    if (!myReader.ready())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in snapshot",
+            "The AST must be up to date before it can be saved", QMessageBox::Ok);
+        return;
+    }
+    auto fileName = QFileDialog::getSaveFileName(this, "Save AST snapshot", QString(), "AST snapshots (*.astsnap)");
+    if (fileName.isEmpty())
+    {
+        return;
+    }
+    if (!myReader.saveSnapshot(fileName.toStdString()))
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in snapshot",
+            "Cannot write file " + fileName, QMessageBox::Ok);
+    }
+}
+
+void MainWindow::OpenSnapshot()
+{
+    StallWatchdog::Activity activity(myWatchdog, "OpenSnapshot");
+    auto fileName = QFileDialog::getOpenFileName(this, "Open AST snapshot", QString(), "AST snapshots (*.astsnap)");
+    if (fileName.isEmpty())
+    {
+        return;
+    }
+    auto ast = myReader.loadSnapshot(fileName.toStdString());
+    if (ast == nullptr)
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in snapshot",
+            fileName + " is not a valid AST snapshot", QMessageBox::Ok);
+        return;
+    }
+    {
+        // The code matches the AST we just loaded, it must not be considered as a modification
+        QSignalBlocker blocker(myUi.codeViewer);
+        myUi.codeViewer->setPlainText(QString::fromStdString(myReader.getSourceCode()));
+    }
+    DisplayAst(ast);
+}
+
+namespace
+{
+// Without recursion, since the diff can be as deep as the trees
+void addDiffItems(QTreeWidget *tree, AstDiffNode const &diff)
+{
+    std::vector<std::pair<AstDiffNode const *, QTreeWidgetItem *>> toAdd; // With the parent item, nullptr at the top level
+    for (auto child = diff.children.rbegin(); child != diff.children.rend(); ++child)
+    {
+        toAdd.emplace_back(&*child, nullptr);
+    }
+    while (!toAdd.empty())
+    {
+        auto &node = *toAdd.back().first;
+        auto parent = toAdd.back().second;
+        toAdd.pop_back();
+        auto item = new QTreeWidgetItem(QStringList{
+            node.left == nullptr ? QString() : QString::fromStdString(node.left->name),
+            node.right == nullptr ? QString() : QString::fromStdString(node.right->name) });
+        switch (node.kind)
+        {
+        case AstDiffNode::Kind::Removed:
+            item->setForeground(0, QBrush(Qt::GlobalColor::darkRed));
+            break;
+        case AstDiffNode::Kind::Added:
+            item->setForeground(1, QBrush(Qt::GlobalColor::darkGreen));
+            break;
+        case AstDiffNode::Kind::Modified:
+            for (auto child = node.children.rbegin(); child != node.children.rend(); ++child)
+            {
+                toAdd.emplace_back(&*child, item);
+            }
+            break;
+        }
+        if (parent == nullptr)
+        {
+            tree->addTopLevelItem(item);
+        }
+        else
+        {
+            parent->addChild(item);
+        }
+    }
+}
+}
+
+void MainWindow::CompareConfigurations()
+{
+    StallWatchdog::Activity activity(myWatchdog, "CompareConfigurations");
+    auto leftArgs = myUi.commandLineArgs->document()->toPlainText();
+    bool ok = false;
+    auto rightArgs = QInputDialog::getText(this, windowTitle() + " - Compare",
+        "Command line arguments to compare with:", QLineEdit::Normal, leftArgs, &ok);
+    if (!ok)
+    {
+        return;
+    }
+    auto code = myUi.codeViewer->document()->toPlainText().toStdString();
+    // Same settings on both sides, otherwise the properties computed by the viewer (collapsed instantiations...) differ
+    AstReader comparisonReader;
+    comparisonReader.copySettings(myReader);
+
+    // Both parses are independent, run them at the same time
+    auto comparisonArgs = rightArgs.toStdString();
+    auto rightFuture = std::async(std::launch::async, [&comparisonReader, &code, &comparisonArgs]()
+    {
+        auto ast = comparisonReader.readAst(code, comparisonArgs);
+        if (comparisonReader.getParseError().empty())
+        {
+            computeStructuralHashes(ast);
+        }
+        return ast;
+    });
+    auto left = myReader.readAst(code, leftArgs.toStdString());
+    if (myReader.getParseError().empty())
+    {
+        computeStructuralHashes(left);
+    }
+    auto right = rightFuture.get();
+    if (!myReader.getParseError().empty() || !comparisonReader.getParseError().empty())
+    {
+        DisplayAst(left);
+        auto error = !myReader.getParseError().empty() ?
+            leftArgs + ":\n" + QString::fromStdString(myReader.getParseError()) :
+            rightArgs + ":\n" + QString::fromStdString(comparisonReader.getParseError());
+        QMessageBox::warning(this, windowTitle() + " - Error in compare", error, QMessageBox::Ok);
+        return;
+    }
+
+    AstDiffNode diff;
+    bool truncated = false;
+    size_t const maxDiffEntries = 100000; // More than that could not be browsed anyway
+    auto isDifferent = diffAsts(left, right, diff, maxDiffEntries, truncated);
+    DisplayAst(left); // After the diff, that may expand collapsed nodes
+    if (!isDifferent)
+    {
+        QMessageBox::information(this, windowTitle() + " - Compare",
+            "Both command lines produce the same AST", QMessageBox::Ok);
+        return;
+    }
+
+    auto win = new QDialog(this);
+    win->setLayout(new QGridLayout());
+    win->resize(size());
+    win->move(pos());
+    win->setWindowTitle(windowTitle() + " - Compare" + (truncated ? " (too many differences, only the first ones are displayed)" : ""));
+    auto tree = new QTreeWidget(win);
+    win->layout()->addWidget(tree);
+    tree->setHeaderLabels({ leftArgs, rightArgs });
+    addDiffItems(tree, diff);
+    tree->expandToDepth(2);
+    myDetailWindows.push_back(win);
+    win->show();
+}
+
 void MainWindow::HighlightCodeMatchingNode(const QModelIndex &newNode, const QModelIndex &previousNode)
 {
+    StallWatchdog::Activity activity(myWatchdog, "HighlightCodeMatchingNode");
     if (isUpdateInProgress)
     {
         return;
     }
     auto lock = UpdateLock{ isUpdateInProgress };
     auto node = myUi.astTreeView->model()->data(newNode, Qt::NodeRole).value<GenericAstNode*>();
-    auto &manager = myReader.getManager();
     std::pair<int, int> location;
-    if (!node->getRangeInMainFile(location, manager, myReader.getContext()))
+    if (!myReader.getRangeInMainFile(node, location))
     {
         return;
     }
@@ -71,8 +412,13 @@ void MainWindow::HighlightCodeMatchingNode(const QModelIndex &newNode, const QMo
 
 void MainWindow::DisplayNodeProperties(const QModelIndex &newNode, const QModelIndex &previousNode)
 {
+    StallWatchdog::Activity activity(myWatchdog, "DisplayNodeProperties");
     myUi.nodeProperties->clear();
     auto node = myUi.astTreeView->model()->data(newNode, Qt::NodeRole).value<GenericAstNode*>();
+    if (myReader.annotateLoopDepths(node))
+    {
+        myUi.astTreeView->viewport()->update(); // For the highlighted statements
+    }
     for (auto &prop : node->getProperties())
     {
         new QTreeWidgetItem(myUi.nodeProperties, QStringList{ QString::fromStdString(prop.first), QString::fromStdString(prop.second) });
@@ -82,6 +428,7 @@ void MainWindow::DisplayNodeProperties(const QModelIndex &newNode, const QModelI
 
 void MainWindow::HighlightNodeMatchingCode()
 {
+    StallWatchdog::Activity activity(myWatchdog, "HighlightNodeMatchingCode");
     if (isUpdateInProgress || !myReader.ready())
     {
         return;
@@ -89,6 +436,11 @@ void MainWindow::HighlightNodeMatchingCode()
     auto lock = UpdateLock{ isUpdateInProgress };
     auto cursorPosition = myUi.codeViewer->textCursor().position();
     auto nodePath = myReader.getBestNodeMatchingPosition(cursorPosition);
+    SelectNodePath(nodePath);
+}
+
+void MainWindow::SelectNodePath(std::vector<GenericAstNode *> const &nodePath)
+{
     auto model = myUi.astTreeView->model();
     if (!nodePath.empty())
     {
@@ -122,8 +474,27 @@ void MainWindow::HighlightNodeMatchingCode()
     }
 }
 
+void MainWindow::SelectNode(GenericAstNode *node)
+{
+    StallWatchdog::Activity activity(myWatchdog, "SelectNode");
+    if (node == nullptr || !myReader.ready())
+    {
+        return;
+    }
+    // The path starts at the real root, the artificial root is not part of it
+    std::vector<GenericAstNode *> nodePath;
+    for (; node != nullptr && node->myParent != nullptr; node = node->myParent)
+    {
+        nodePath.push_back(node);
+    }
+    std::reverse(nodePath.begin(), nodePath.end());
+    SelectNodePath(nodePath);
+}
+
 void MainWindow::ShowNodeDetails()
 {
+    TRACE_SCOPE("MainWindow::ShowNodeDetails");
+    StallWatchdog::Activity activity(myWatchdog, "ShowNodeDetails");
     auto selectionModel = myUi.astTreeView->selectionModel();
     auto model = myUi.astTreeView->model();
     auto node = myUi.astTreeView->model()->data(selectionModel->currentIndex(), Qt::NodeRole).value<GenericAstNode*>();
@@ -152,12 +523,777 @@ void MainWindow::ShowNodeDetails()
 }
 
 
+void MainWindow::FillReportTable(QTreeWidget *table, AnalysisReport const &report)
+{
+    InitReportTable(table, report.headers);
+    AppendReportRows(table, report.rows);
+    table->header()->setSortIndicator(-1, Qt::AscendingOrder); // Keep the order of the report until the user asks otherwise
+    table->setSortingEnabled(true);
+}
+
+void MainWindow::InitReportTable(QTreeWidget *table, std::vector<std::string> const &headers)
+{
+    table->clear();
+    table->setSortingEnabled(false);
+    QStringList labels;
+    for (auto &header : headers)
+    {
+        labels << QString::fromStdString(header);
+    }
+    table->setHeaderLabels(labels);
+    table->setRootIsDecorated(false);
+}
+
+namespace
+{
+QTreeWidgetItem *createReportItem(AnalysisReport::Row const &row)
+{
+    auto item = new QTreeWidgetItem;
+    for (int i = 0; i < static_cast<int>(row.cells.size()); ++i)
+    {
+        // Numbers are stored as such, so that sorting by this column makes sense
+        auto text = QString::fromStdString(row.cells[i]);
+        bool isInteger = false;
+        auto integer = text.toLongLong(&isInteger);
+        bool isNumber = false;
+        auto number = text.toDouble(&isNumber);
+        item->setData(i, Qt::DisplayRole, isInteger ? QVariant(integer) : isNumber ? QVariant(number) : QVariant(text));
+    }
+    item->setData(0, Qt::NodeRole, QVariant::fromValue(row.node));
+    for (auto &child : row.children)
+    {
+        item->addChild(createReportItem(child));
+    }
+    return item;
+}
+}
+
+void MainWindow::AppendReportRows(QTreeWidget *table, std::vector<AnalysisReport::Row> const &rows)
+{
+    for (auto &row : rows)
+    {
+        table->addTopLevelItem(createReportItem(row));
+        if (!row.children.empty())
+        {
+            table->setRootIsDecorated(true);
+        }
+    }
+}
+
+void MainWindow::ShowReport(AnalysisReport const &report)
+{
+    auto win = new QDialog(this);
+    win->setLayout(new QGridLayout());
+    win->resize(size());
+    win->move(pos());
+    win->setWindowTitle(windowTitle() + " - " + QString::fromStdString(report.title));
+    auto table = new QTreeWidget(win);
+    win->layout()->addWidget(table);
+    FillReportTable(table, report);
+    connect(table, &QTreeWidget::itemDoubleClicked, this, [this](QTreeWidgetItem *item, int)
+    {
+        SelectNode(item->data(0, Qt::NodeRole).value<GenericAstNode*>());
+    });
+    myReportWindows.push_back(win);
+    win->show();
+}
+
+void MainWindow::RunQuery()
+{
+    StallWatchdog::Activity activity(myWatchdog, "RunQuery");
+    myQueryTimer->stop();
+    myPathQuery.reset();
+    if (myUi.queryLanguage->currentIndex() == PathLanguage)
+    {
+        RunPathQuery();
+        return;
+    }
+    if (!myReader.ready() || myReader.isDetached())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in query",
+            "Matchers can only be run when the AST is up to date, and not detached", QMessageBox::Ok);
+        return;
+    }
+    AnalysisReport report;
+    std::string error;
+    if (!myReader.runMatcherQuery(myUi.queryInput->text().toStdString(), report, error))
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in query", QString::fromStdString(error), QMessageBox::Ok);
+        return;
+    }
+    FillReportTable(myUi.queryResults, report);
+    myUi.statusbar->showMessage(QString::fromStdString(report.title) + QString(": %1 matches").arg(report.rows.size()));
+}
+
+void MainWindow::RunPathQuery()
+{
+    if (!myReader.ready())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in query",
+            "Queries can only be run when the AST is up to date", QMessageBox::Ok);
+        return;
+    }
+    std::string error;
+    myPathQuery = PathQuery::compile(myUi.queryInput->text().toStdString(), error);
+    if (myPathQuery == nullptr)
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in query", QString::fromStdString(error), QMessageBox::Ok);
+        return;
+    }
+    myPathQuery->start(myPathIndex);
+    myPathQueryMatches = 0;
+    InitReportTable(myUi.queryResults, { "Node", "Name", "Line" });
+    myQueryTimer->start(0);
+}
+
+void MainWindow::ContinuePathQuery()
+{
+    StallWatchdog::Activity activity(myWatchdog, "ContinuePathQuery");
+    if (!myReader.ready())
+    {
+        // The tree changed, or a background computation uses clang, that lazy properties may need
+        StopPathQuery();
+        return;
+    }
+    // Results are displayed as they are found, the UI stays responsive even on very large trees
+    std::vector<GenericAstNode *> found;
+    auto hasMore = myPathQuery->run(pathQueryBudget, found);
+    std::vector<AnalysisReport::Row> rows;
+    for (auto node : found)
+    {
+        auto &properties = node->getProperties();
+        auto name = properties.find("Name");
+        if (name == properties.end())
+        {
+            name = properties.find("Referenced name");
+        }
+        std::pair<int, int> range;
+        auto line = myReader.getRangeInMainFile(node, range) ?
+            std::to_string(myUi.codeViewer->document()->findBlock(range.first).blockNumber() + 1) :
+            std::string();
+        rows.push_back(AnalysisReport::Row{ node, { node->name, name != properties.end() ? name->second : "", line } });
+    }
+    AppendReportRows(myUi.queryResults, rows);
+    myPathQueryMatches += found.size();
+    if (hasMore)
+    {
+        myUi.statusbar->showMessage(QString("Query running: %1 matches so far").arg(myPathQueryMatches));
+        return;
+    }
+    myQueryTimer->stop();
+    myPathQuery.reset();
+    myUi.queryResults->header()->setSortIndicator(-1, Qt::AscendingOrder);
+    myUi.queryResults->setSortingEnabled(true);
+    myUi.statusbar->showMessage(QString("Query: %1 matches").arg(myPathQueryMatches));
+}
+
+void MainWindow::ShowTemplateBloat()
+{
+    StallWatchdog::Activity activity(myWatchdog, "ShowTemplateBloat");
+    if (!myReader.ready() || myReader.isDetached())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in report",
+            "Instantiations are only measured when the AST is up to date, not detached, and instantiations are collapsed", QMessageBox::Ok);
+        return;
+    }
+    ShowReport(myReader.getTemplateBloatReport());
+}
+
+void MainWindow::StopPathQuery()
+{
+    if (myPathQuery == nullptr)
+    {
+        return;
+    }
+    myQueryTimer->stop();
+    myPathQuery.reset();
+    myUi.statusbar->showMessage(QString("Query interrupted: %1 matches").arg(myPathQueryMatches));
+}
+
+void MainWindow::ShowFunctionWeights()
+{
+    StallWatchdog::Activity activity(myWatchdog, "ShowFunctionWeights");
+    if (!myReader.ready() || myReader.isDetached())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in report",
+            "Function weights can only be computed when the AST is up to date, and not detached", QMessageBox::Ok);
+        return;
+    }
+    // Nothing can use clang until the weights are computed
+    StopPathQuery();
+    myReader.startFunctionWeights();
+    myUi.astTreeView->setEnabled(false);
+    myUi.showDetails->setEnabled(false);
+    myUi.statusbar->showMessage("Computing function weights...");
+    myWeightsTimer->start();
+}
+
+void MainWindow::CheckFunctionWeights()
+{
+    StallWatchdog::Activity activity(myWatchdog, "CheckFunctionWeights");
+    if (!myReader.computingFunctionWeights())
+    {
+        // Discarded by a refresh
+        myWeightsTimer->stop();
+        myUi.showDetails->setEnabled(true);
+        return;
+    }
+    if (!myReader.functionWeightsComputed())
+    {
+        return;
+    }
+    myWeightsTimer->stop();
+    auto report = myReader.takeFunctionWeightsReport();
+    myUi.astTreeView->setEnabled(myReader.ready());
+    myUi.showDetails->setEnabled(true);
+    myUi.statusbar->showMessage(QString("%1 functions weighted").arg(report.rows.size()));
+    ShowReport(report);
+}
+
+void MainWindow::ShowRecordPadding()
+{
+    StallWatchdog::Activity activity(myWatchdog, "ShowRecordPadding");
+    if (!myReader.ready() || myReader.isDetached())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in report",
+            "Record layouts can only be computed when the AST is up to date, and not detached", QMessageBox::Ok);
+        return;
+    }
+    ShowReport(myReader.getRecordPaddingReport());
+}
+
+void MainWindow::SetCacheLineSize()
+{
+    bool ok = false;
+    auto size = QInputDialog::getInt(this, windowTitle() + " - Cache line size",
+        "Cache line size in bytes (record layouts of the nodes are updated at the next refresh):", myCacheLineSize, 1, 4096, 1, &ok);
+    if (ok)
+    {
+        myCacheLineSize = size;
+        myReader.setCacheLineSize(size);
+    }
+}
+
+void MainWindow::SetModuleCache()
+{
+    auto directory = QFileDialog::getExistingDirectory(this, "Module cache directory", QString::fromStdString(myReader.getModuleCacheDirectory()));
+    if (directory.isEmpty())
+    {
+        return;
+    }
+    uint64_t const megabyte = 1024 * 1024;
+    bool ok = false;
+    auto sizeLimit = QInputDialog::getInt(this, windowTitle() + " - Module cache",
+        "Size limit in MB (the cache is pruned after each parse):", static_cast<int>(myReader.getModuleCacheSizeLimit() / megabyte), 1, 1 << 20, 1, &ok);
+    if (ok)
+    {
+        myReader.setModuleCacheLocation(directory.toStdString(), sizeLimit * megabyte);
+    }
+}
+
+void MainWindow::ShowHiddenCopies()
+{
+    StallWatchdog::Activity activity(myWatchdog, "ShowHiddenCopies");
+    if (!myReader.ready() || myReader.isDetached())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in report",
+            "Copies can only be found when the AST is up to date, and not detached", QMessageBox::Ok);
+        return;
+    }
+    bool ok = false;
+    auto minSize = QInputDialog::getInt(this, windowTitle() + " - Hidden copies",
+        "Only report copies of types of at least (bytes):", myHiddenCopyMinSize, 1, 1 << 30, 1, &ok);
+    if (!ok)
+    {
+        return;
+    }
+    myHiddenCopyMinSize = minSize;
+    ShowReport(myReader.getHiddenCopiesReport(minSize));
+}
+
+void MainWindow::ShowMoveAudit()
+{
+    StallWatchdog::Activity activity(myWatchdog, "ShowMoveAudit");
+    if (!myReader.ready() || myReader.isDetached())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in report",
+            "Moves can only be audited when the AST is up to date, and not detached", QMessageBox::Ok);
+        return;
+    }
+    ShowReport(myReader.getMoveAuditReport());
+}
+
+void MainWindow::ShowAllocationSites()
+{
+    StallWatchdog::Activity activity(myWatchdog, "ShowAllocationSites");
+    if (!myReader.ready() || myReader.isDetached())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in report",
+            "Allocations can only be found when the AST is up to date, and not detached", QMessageBox::Ok);
+        return;
+    }
+    ShowReport(myReader.getAllocationSitesReport());
+}
+
+void MainWindow::ShowVirtualCalls()
+{
+    StallWatchdog::Activity activity(myWatchdog, "ShowVirtualCalls");
+    if (!myReader.ready() || myReader.isDetached())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in report",
+            "Virtual calls can only be found when the AST is up to date, and not detached", QMessageBox::Ok);
+        return;
+    }
+    ShowReport(myReader.getVirtualCallsReport());
+}
+
+void MainWindow::ShowGeneratedCode()
+{
+    StallWatchdog::Activity activity(myWatchdog, "ShowGeneratedCode");
+    if (!myReader.ready() || myReader.isDetached())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in details",
+            "Code can only be generated when the AST is up to date, and not detached", QMessageBox::Ok);
+        return;
+    }
+    auto node = myUi.astTreeView->model()->data(myUi.astTreeView->selectionModel()->currentIndex(), Qt::NodeRole).value<GenericAstNode*>();
+    std::shared_ptr<FunctionCode const> code;
+    std::string error;
+    if (node == nullptr || !myReader.getFunctionCode(node, myOptimizationLevel.toStdString(), code, error))
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in details",
+            node == nullptr ? "No function is selected" : QString::fromStdString(error), QMessageBox::Ok);
+        return;
+    }
+    if (code != nullptr)
+    {
+        ShowFunctionCode(node, *code);
+        return;
+    }
+    myCodeRequestNode = node;
+    myUi.statusbar->showMessage("Compiling the translation unit at " + myOptimizationLevel + "...");
+    myCodeTimer->start();
+}
+
+void MainWindow::CheckGeneratedCode()
+{
+    StallWatchdog::Activity activity(myWatchdog, "CheckGeneratedCode");
+    std::string error;
+    if (!myReader.finishCodeCompilation(error))
+    {
+        if (!myReader.compilingCode())
+        {
+            myCodeTimer->stop();
+        }
+        return;
+    }
+    myCodeTimer->stop();
+    auto node = myCodeRequestNode;
+    myCodeRequestNode = nullptr;
+    if (!error.empty())
+    {
+        myUi.statusbar->showMessage("Code generation failed");
+        QMessageBox::warning(this, windowTitle() + " - Error in details", QString::fromStdString(error), QMessageBox::Ok);
+        return;
+    }
+    myUi.statusbar->showMessage("Code generated");
+    std::shared_ptr<FunctionCode const> code;
+    if (node == nullptr || !myReader.ready() || myReader.isDetached() || !myReader.getFunctionCode(node, myOptimizationLevel.toStdString(), code, error))
+    {
+        return;
+    }
+    if (code != nullptr)
+    {
+        ShowFunctionCode(node, *code);
+    }
+    else
+    {
+        // The optimization level changed during the compilation
+        myCodeRequestNode = node;
+        myCodeTimer->start();
+    }
+}
+
+void MainWindow::SetOptimizationLevel()
+{
+    QStringList levels{ "-O0", "-O1", "-O2", "-O3", "-Os", "-Oz" };
+    bool ok = false;
+    auto level = QInputDialog::getItem(this, windowTitle() + " - Optimization level",
+        "Optimization level of the generated code:", levels, levels.indexOf(myOptimizationLevel), false, &ok);
+    if (ok)
+    {
+        myOptimizationLevel = level;
+    }
+}
+
+void MainWindow::ShowOptimizationRemarks()
+{
+    StallWatchdog::Activity activity(myWatchdog, "ShowOptimizationRemarks");
+    if (!myReader.ready())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in report",
+            "Optimization remarks can only be collected when the AST is up to date", QMessageBox::Ok);
+        return;
+    }
+    if (!myReader.startOptimizationRemarks(myOptimizationLevel.toStdString()))
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in report",
+            "Optimization remarks are already being collected", QMessageBox::Ok);
+        return;
+    }
+    myUi.statusbar->showMessage("Collecting optimization remarks at " + myOptimizationLevel + "...");
+    myRemarksTimer->start();
+}
+
+void MainWindow::CheckOptimizationRemarks()
+{
+    StallWatchdog::Activity activity(myWatchdog, "CheckOptimizationRemarks");
+    if (!myReader.optimizationRemarksComputed())
+    {
+        return;
+    }
+    myRemarksTimer->stop();
+    AnalysisReport report;
+    std::string error;
+    if (!myReader.takeOptimizationRemarks(report, error))
+    {
+        myUi.statusbar->showMessage("No optimization remarks");
+        QMessageBox::warning(this, windowTitle() + " - Error in report", QString::fromStdString(error), QMessageBox::Ok);
+        return;
+    }
+    myUi.statusbar->showMessage(QString("%1 optimization remarks").arg(report.rows.size()));
+    // Badges and properties have been added to the nodes
+    myUi.astTreeView->viewport()->update();
+    auto currentIndex = myUi.astTreeView->selectionModel()->currentIndex();
+    if (currentIndex.isValid())
+    {
+        DisplayNodeProperties(currentIndex, currentIndex);
+    }
+    ShowReport(report);
+}
+
+void MainWindow::ShowFunctionCode(GenericAstNode *node, FunctionCode const &code)
+{
+    auto win = new QDialog(this);
+    win->setLayout(new QGridLayout());
+    win->resize(size());
+    win->move(pos());
+    win->setWindowTitle(windowTitle() + " - " + QString::fromStdString(node->name) + " - Code at " + myOptimizationLevel);
+    auto tabs = new QTabWidget(win);
+    win->layout()->addWidget(tabs);
+    auto addTab = [tabs](std::string const &text, QString const &title)
+    {
+        auto edit = new QTextEdit(tabs);
+        edit->setLineWrapMode(QTextEdit::NoWrap);
+        edit->setPlainText(QString::fromStdString(text));
+        edit->setReadOnly(true);
+        tabs->addTab(edit, title);
+    };
+    if (!code.emitted)
+    {
+        addTab("No code was emitted for this function: it is unused, or has been inlined everywhere", "IR");
+    }
+    else
+    {
+        addTab(code.ir, QString("IR (%1 instructions)").arg(code.irInstructions));
+        if (code.assemblyError.empty())
+        {
+            addTab(code.assembly, QString("Assembly (%1 instructions)").arg(code.machineInstructions));
+        }
+        else
+        {
+            addTab(code.assemblyError, "Assembly");
+        }
+    }
+    myDetailWindows.push_back(win);
+    win->show();
+}
+
+void MainWindow::SaveTrace()
+{
+    StallWatchdog::Activity activity(myWatchdog, "SaveTrace");
+    auto fileName = QFileDialog::getSaveFileName(this, "Save trace", QString(), "Chrome traces (*.json)");
+    if (fileName.isEmpty())
+    {
+        return;
+    }
+    if (!trace::save(fileName.toStdString()))
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in trace",
+            "Cannot write file " + fileName, QMessageBox::Ok);
+    }
+}
+
+void MainWindow::ShowStalls()
+{
+    StallWatchdog::Activity activity(myWatchdog, "ShowStalls");
+    ShowReport(myWatchdog.getReport());
+}
+
+void MainWindow::SetStallThreshold()
+{
+    bool ok = false;
+    auto threshold = QInputDialog::getInt(this, windowTitle() + " - Stall threshold",
+        "Report the event loop as stalled when it does not run for (ms):", myWatchdog.getThreshold(), 20, 60000, 10, &ok);
+    if (ok)
+    {
+        myWatchdog.setThreshold(threshold);
+    }
+}
+
+void MainWindow::IndexProject()
+{
+    StallWatchdog::Activity activity(myWatchdog, "IndexProject");
+    if (myIndexing.valid())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in index", "The project is already being indexed", QMessageBox::Ok);
+        return;
+    }
+    auto directory = QFileDialog::getExistingDirectory(this, "Directory containing compile_commands.json");
+    if (directory.isEmpty())
+    {
+        return;
+    }
+    auto fileName = QFileDialog::getSaveFileName(this, "Save cross reference index", QString(), "Cross reference indexes (*.xref)");
+    if (fileName.isEmpty())
+    {
+        return;
+    }
+    // Parsing a whole project takes a while, the viewer stays usable in the meantime: The parsing happens in
+    // worker processes, only waiting for them and merging their results happens in this one
+    myIndexFile = fileName;
+    auto directoryName = directory.toStdString();
+    auto indexFile = fileName.toStdString();
+    auto executable = QCoreApplication::applicationFilePath().toStdString();
+    myIndexing = std::async(std::launch::async, [directoryName, indexFile, executable]()
+    {
+        std::string error;
+        if (!buildXRefIndex(directoryName, indexFile, executable, error) && error.empty())
+        {
+            error = "The project could not be indexed";
+        }
+        return error;
+    });
+    myUi.statusbar->showMessage("Indexing the project...");
+    myIndexTimer->start();
+}
+
+void MainWindow::CheckProjectIndex()
+{
+    StallWatchdog::Activity activity(myWatchdog, "CheckProjectIndex");
+    if (myIndexing.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        return;
+    }
+    myIndexTimer->stop();
+    auto error = myIndexing.get();
+    if (!error.empty())
+    {
+        myUi.statusbar->showMessage("Indexing failed");
+        QMessageBox::warning(this, windowTitle() + " - Error in index", QString::fromStdString(error), QMessageBox::Ok);
+        return;
+    }
+    if (!myReader.openXRefIndex(myIndexFile.toStdString()))
+    {
+        myUi.statusbar->showMessage("Indexing failed");
+        QMessageBox::warning(this, windowTitle() + " - Error in index", "Cannot open " + myIndexFile, QMessageBox::Ok);
+        return;
+    }
+    myUi.statusbar->showMessage("Project indexed");
+}
+
+void MainWindow::OpenIndex()
+{
+    StallWatchdog::Activity activity(myWatchdog, "OpenIndex");
+    auto fileName = QFileDialog::getOpenFileName(this, "Open cross reference index", QString(), "Cross reference indexes (*.xref)");
+    if (fileName.isEmpty())
+    {
+        return;
+    }
+    if (!myReader.openXRefIndex(fileName.toStdString()))
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in index",
+            "File " + fileName + " is not a valid index", QMessageBox::Ok);
+    }
+}
+
+void MainWindow::GoToDefinition()
+{
+    StallWatchdog::Activity activity(myWatchdog, "GoToDefinition");
+    AnalysisReport report;
+    if (!FindReferences(true, report))
+    {
+        return;
+    }
+    // Most of the time, there is just one place to go
+    if (report.rows.size() == 1 && report.rows.front().node != nullptr)
+    {
+        SelectNode(report.rows.front().node);
+        return;
+    }
+    ShowReport(report);
+}
+
+void MainWindow::FindAllReferences()
+{
+    StallWatchdog::Activity activity(myWatchdog, "FindAllReferences");
+    AnalysisReport report;
+    if (FindReferences(false, report))
+    {
+        ShowReport(report);
+    }
+}
+
+bool MainWindow::FindReferences(bool definitionsOnly, AnalysisReport &report)
+{
+    if (!myReader.ready() || myReader.isDetached())
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in references",
+            "References can only be looked up when the AST is up to date, and not detached", QMessageBox::Ok);
+        return false;
+    }
+    auto node = myUi.astTreeView->model()->data(myUi.astTreeView->selectionModel()->currentIndex(), Qt::NodeRole).value<GenericAstNode*>();
+    std::string error;
+    if (node == nullptr || !myReader.findReferences(node, definitionsOnly, report, error))
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in references",
+            node == nullptr ? "No node selected" : QString::fromStdString(error), QMessageBox::Ok);
+        return false;
+    }
+    return true;
+}
+
+namespace
+{
+QTreeWidgetItem *createIncludeProfileItem(IncludeProfileNode const &node)
+{
+    auto item = new QTreeWidgetItem;
+    item->setText(0, QString::fromStdString(node.file));
+    item->setData(1, Qt::DisplayRole, node.includeLine);
+    item->setData(2, Qt::DisplayRole, node.selfSeconds * 1000);
+    item->setData(3, Qt::DisplayRole, node.inclusiveSeconds * 1000);
+    item->setData(4, Qt::DisplayRole, node.tokens);
+    item->setData(5, Qt::DisplayRole, node.selfNodes);
+    item->setData(6, Qt::DisplayRole, node.inclusiveNodes);
+    item->setData(7, Qt::DisplayRole, static_cast<qulonglong>(node.selfBytes));
+    item->setData(8, Qt::DisplayRole, static_cast<qulonglong>(node.inclusiveBytes));
+    for (auto &child : node.children)
+    {
+        item->addChild(createIncludeProfileItem(*child));
+    }
+    return item;
+}
+}
+
+void MainWindow::ShowIncludeProfile()
+{
+    StallWatchdog::Activity activity(myWatchdog, "ShowIncludeProfile");
+    auto profile = myReader.getIncludeProfile();
+    if (profile == nullptr)
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in profile",
+            "Includes are only profiled when the option is set before refreshing the AST", QMessageBox::Ok);
+        return;
+    }
+    auto win = new QDialog(this);
+    auto layout = new QGridLayout();
+    win->setLayout(layout);
+    win->resize(size());
+    win->move(pos());
+    win->setWindowTitle(windowTitle() + " - Include profile");
+    auto tree = new QTreeWidget(win);
+    tree->setHeaderLabels({ "File", "Line", "Self ms", "Inclusive ms", "Tokens", "Self nodes", "Inclusive nodes", "Self bytes", "Inclusive bytes" });
+    for (auto &child : profile->children)
+    {
+        tree->addTopLevelItem(createIncludeProfileItem(*child));
+    }
+    tree->header()->setSortIndicator(-1, Qt::AscendingOrder); // Include order until the user asks otherwise
+    tree->setSortingEnabled(true);
+    tree->expandToDepth(0);
+    layout->addWidget(tree, 0, 0, 1, 2);
+    auto exportButton = new QPushButton("Export JSON", win);
+    layout->addWidget(exportButton, 1, 1);
+    auto json = includeProfileToJson(*profile); // The profile may change if the AST is refreshed while the window is open
+    connect(exportButton, &QPushButton::clicked, this, [this, json]()
+    {
+        auto fileName = QFileDialog::getSaveFileName(this, "Export include profile", QString(), "JSON files (*.json)");
+        if (fileName.isEmpty())
+        {
+            return;
+        }
+        QFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly) || file.write(json.data(), json.size()) != static_cast<qint64>(json.size()))
+        {
+            QMessageBox::warning(this, windowTitle() + " - Error in profile", "Cannot write file " + fileName, QMessageBox::Ok);
+        }
+    });
+    myReportWindows.push_back(win);
+    win->show();
+}
+
+void MainWindow::ShowMacroProfile()
+{
+    StallWatchdog::Activity activity(myWatchdog, "ShowMacroProfile");
+    auto profile = myReader.getMacroProfile();
+    if (profile == nullptr)
+    {
+        QMessageBox::warning(this, windowTitle() + " - Error in profile",
+            "Macros are only profiled when the option is set before refreshing the AST", QMessageBox::Ok);
+        return;
+    }
+    auto win = new QDialog(this);
+    win->setLayout(new QGridLayout());
+    win->resize(size());
+    win->move(pos());
+    win->setWindowTitle(windowTitle() + " - Macro profile");
+    auto tree = new QTreeWidget(win);
+    tree->setHeaderLabels({ "Macro / Node", "Definition / Position", "Expansions", "Expanded tokens", "Tokens per expansion", "Nested expansions", "Max depth" });
+    for (auto &entry : *profile)
+    {
+        auto item = new QTreeWidgetItem(tree);
+        item->setText(0, QString::fromStdString(entry.name));
+        item->setText(1, QString::fromStdString(entry.definition));
+        item->setData(2, Qt::DisplayRole, entry.expansions);
+        item->setData(3, Qt::DisplayRole, static_cast<qulonglong>(entry.expandedTokens));
+        item->setData(4, Qt::DisplayRole, static_cast<double>(entry.expandedTokens) / entry.expansions);
+        item->setData(5, Qt::DisplayRole, entry.nestedExpansions);
+        item->setData(6, Qt::DisplayRole, entry.maxDepth);
+        // Only the first sites are kept for each macro
+        for (auto &site : entry.sites)
+        {
+            auto siteItem = new QTreeWidgetItem(item);
+            siteItem->setText(0, site.node != nullptr ? QString::fromStdString(site.node->name) : QString());
+            siteItem->setText(1, QString::fromStdString(site.position));
+            siteItem->setData(3, Qt::DisplayRole, site.tokens);
+            siteItem->setData(6, Qt::DisplayRole, site.depth);
+            siteItem->setData(0, Qt::NodeRole, QVariant::fromValue(site.node));
+        }
+    }
+    tree->header()->setSortIndicator(-1, Qt::AscendingOrder); // Sorted by expanded tokens until the user asks otherwise
+    tree->setSortingEnabled(true);
+    win->layout()->addWidget(tree);
+    connect(tree, &QTreeWidget::itemDoubleClicked, this, [this](QTreeWidgetItem *item, int)
+    {
+        auto node = item->data(0, Qt::NodeRole).value<GenericAstNode*>();
+        if (node != nullptr)
+        {
+            SelectNode(node);
+        }
+    });
+    myReportWindows.push_back(win);
+    win->show();
+}
+
 void MainWindow::closeEvent(QCloseEvent *event)
 {
     for (auto win : myDetailWindows)
     {
         win->close();
     }
+    for (auto win : myReportWindows)
+    {
+        win->close();
+    }
     event->accept();
 }
 
@@ -3,6 +3,8 @@
 #include "ui_MainWindow.h"
 #include "Highlighter.h"
 #include "AstReader.h"
+#include "PathQuery.h"
+#include "StallWatchdog.h"
 
 
 class MainWindow : public QMainWindow
@@ -17,11 +19,70 @@ public slots:
     void HighlightNodeMatchingCode();
     void ShowNodeDetails();
     void OnCodeChange();
+    void UpdateDetachedMode();
+    void SaveSnapshot();
+    void OpenSnapshot();
+    void CompareConfigurations();
+    void ShowTemplateBloat();
+    void RunQuery();
+    void ContinuePathQuery();
+    void IndexProject();
+    void CheckProjectIndex();
+    void OpenIndex();
+    void GoToDefinition();
+    void FindAllReferences();
+    void ShowIncludeProfile();
+    void ShowMacroProfile();
+    void ShowFunctionWeights();
+    void CheckFunctionWeights();
+    void ShowRecordPadding();
+    void SetCacheLineSize();
+    void SetModuleCache();
+    void ShowHiddenCopies();
+    void ShowMoveAudit();
+    void ShowAllocationSites();
+    void ShowVirtualCalls();
+    void ShowGeneratedCode();
+    void CheckGeneratedCode();
+    void SetOptimizationLevel();
+    void ShowOptimizationRemarks();
+    void SaveTrace();
+    void ShowStalls();
+    void SetStallThreshold();
+    void CheckOptimizationRemarks();
+    void SelectNode(GenericAstNode *node);
     void closeEvent(QCloseEvent *event) override;
 private:
+    void DisplayAst(GenericAstNode *ast);
+    void SelectNodePath(std::vector<GenericAstNode *> const &nodePath); // Path from the real root to the node
+    void FillReportTable(QTreeWidget *table, AnalysisReport const &report);
+    void InitReportTable(QTreeWidget *table, std::vector<std::string> const &headers);
+    void AppendReportRows(QTreeWidget *table, std::vector<AnalysisReport::Row> const &rows);
+    void RunPathQuery();
+    void StopPathQuery(); // Keeps the results found so far
+    bool FindReferences(bool definitionsOnly, AnalysisReport &report); // For the selected node, displays errors
+    void ShowReport(AnalysisReport const &report);
+    void ShowFunctionCode(GenericAstNode *node, FunctionCode const &code);
     Ui::MainWindow myUi;
     Highlighter *myHighlighter; // No need to delete, since is will have a parent that will take care of that
     AstReader myReader;
     std::vector<QDialog *> myDetailWindows;
+    std::vector<QDialog *> myReportWindows; // Closed when the tree changes, since they point to its nodes
+    PathIndex myPathIndex; // For the tree currently displayed
+    std::unique_ptr<PathQuery> myPathQuery; // The query being run, if any
+    size_t myPathQueryMatches;
+    QTimer *myQueryTimer; // Runs the path query by small chunks
+    QTimer *myWeightsTimer; // Waits for the function weights computed in the background
+    QTimer *myCodeTimer; // Waits for the code compiled in the background
+    QTimer *myRemarksTimer; // Waits for the optimization remarks collected in the background
+    QTimer *myIndexTimer; // Waits for the project indexed in the background
+    QTimer *myBeatTimer; // Tells the watchdog that the event loop runs
+    StallWatchdog myWatchdog;
+    GenericAstNode *myCodeRequestNode; // Function whose code is displayed when the compilation ends, nullptr if none
+    QString myOptimizationLevel;
+    int myCacheLineSize;
+    int myHiddenCopyMinSize; // Last threshold used, in bytes
     bool isUpdateInProgress;
+    QString myIndexFile; // Opened when the indexing ends
+    std::future<std::string> myIndexing; // Error message, empty on success. Last member, so that the indexing ends before the window is destroyed
 };
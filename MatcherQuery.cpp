@@ -0,0 +1,77 @@
+#include "MatcherQuery.h"
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include <clang/ASTMatchers/Dynamic/Parser.h>
+#include <clang/ASTMatchers/Dynamic/Diagnostics.h>
+#pragma warning (pop)
+
+using namespace clang::ast_matchers;
+
+namespace
+{
+
+char const rootId[] = "root"; // Same as clang-query
+
+class MatchCollector : public MatchFinder::MatchCallback
+{
+public:
+    MatchCollector(size_t maxMatches, std::vector<clang::ast_type_traits::DynTypedNode> &matches) :
+        myMaxMatches(maxMatches), myMatches(matches), isTruncated(false)
+    {
+    }
+
+    void run(MatchFinder::MatchResult const &result) override
+    {
+        auto &boundNodes = result.Nodes.getMap();
+        auto it = boundNodes.find(rootId);
+        if (it == boundNodes.end())
+        {
+            return;
+        }
+        if (myMatches.size() == myMaxMatches)
+        {
+            isTruncated = true;
+            return;
+        }
+        myMatches.push_back(it->second);
+    }
+
+    bool truncated()
+    {
+        return isTruncated;
+    }
+
+private:
+    size_t myMaxMatches;
+    std::vector<clang::ast_type_traits::DynTypedNode> &myMatches;
+    bool isTruncated;
+};
+
+} // namespace
+
+
+bool findMatches(std::string const &query, clang::ASTContext &context, size_t maxMatches,
+    std::vector<clang::ast_type_traits::DynTypedNode> &matches, bool &truncated, std::string &error)
+{
+    dynamic::Diagnostics diagnostics;
+    auto matcher = dynamic::Parser::parseMatcherExpression(query, &diagnostics);
+    if (!matcher)
+    {
+        error = diagnostics.toStringFull();
+        return false;
+    }
+    auto boundMatcher = matcher->tryBind(rootId);
+    if (!boundMatcher)
+    {
+        error = "This kind of matcher cannot be used at the top level of a query";
+        return false;
+    }
+    MatchCollector collector(maxMatches, matches);
+    MatchFinder finder;
+    finder.addDynamicMatcher(*boundMatcher, &collector);
+    finder.matchAST(context);
+    truncated = collector.truncated();
+    return true;
+}
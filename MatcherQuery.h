@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/ASTTypeTraits.h>
+#pragma warning (pop)
+
+// Runs a dynamic matcher expression, with the same syntax as clang-query (for instance
+// functionDecl(hasName("f"), isDefinition())), on the whole translation unit. The matching is done by
+// clang on its own AST, independently of the GenericAstNode tree, which may be partially built.
+// Return false and fill error if the expression is not valid. At most maxMatches are reported.
+bool findMatches(std::string const &query, clang::ASTContext &context, size_t maxMatches,
+    std::vector<clang::ast_type_traits::DynTypedNode> &matches, bool &truncated, std::string &error);
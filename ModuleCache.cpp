@@ -0,0 +1,183 @@
+#include "ModuleCache.h"
+#include <algorithm>
+#include <iostream>
+#include <set>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Serialization/ASTReader.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#pragma warning (pop)
+
+namespace
+{
+uint64_t const defaultSizeLimit = uint64_t(2) * 1024 * 1024 * 1024;
+}
+
+ModuleCache::ModuleCache() : myEnabled(false), mySizeLimit(defaultSizeLimit)
+{
+    // Not erased on reboot, modules are meant to be shared between sessions
+    llvm::SmallString<256> path;
+    llvm::sys::path::system_temp_directory(false, path);
+    llvm::sys::path::append(path, "ClangAstViewer", "ModuleCache");
+    myDirectory = path.str();
+}
+
+void ModuleCache::setEnabled(bool enabled)
+{
+    myEnabled = enabled;
+}
+
+bool ModuleCache::enabled()
+{
+    return myEnabled;
+}
+
+void ModuleCache::setLocation(std::string const &directory, uint64_t sizeLimit)
+{
+    myDirectory = directory;
+    mySizeLimit = sizeLimit;
+}
+
+void ModuleCache::copySettings(ModuleCache const &other)
+{
+    myEnabled = other.myEnabled;
+    myDirectory = other.myDirectory;
+    mySizeLimit = other.mySizeLimit;
+}
+
+std::string const &ModuleCache::directory()
+{
+    return myDirectory;
+}
+
+uint64_t ModuleCache::sizeLimit()
+{
+    return mySizeLimit;
+}
+
+std::vector<std::string> ModuleCache::arguments()
+{
+    if (!myEnabled)
+    {
+        return {};
+    }
+    return { "-fmodules", "-fimplicit-module-maps", "-fmodules-cache-path=" + myDirectory };
+}
+
+void ModuleCache::beforeParse()
+{
+    myLastParseModules.clear();
+    if (myEnabled)
+    {
+        myModulesBeforeParse = listModules();
+    }
+}
+
+void ModuleCache::afterParse(clang::ASTUnit *ast)
+{
+    if (!myEnabled)
+    {
+        return;
+    }
+    auto modules = listModules();
+    std::set<FileId> usedModules;
+    if (ast != nullptr && ast->getASTReader() != nullptr)
+    {
+        for (auto module : ast->getASTReader()->getModuleManager())
+        {
+            if (module->Kind != clang::serialization::MK_ImplicitModule)
+            {
+                continue; // Precompiled headers, explicit modules...
+            }
+            // Clang writes a module to a temporary file that it renames, so a module (re)built during the parse is a
+            // new file, with an id that was not in the cache before. Modification times are too coarse to tell.
+            bool hitCache = false;
+            llvm::sys::fs::UniqueID id;
+            if (!llvm::sys::fs::getUniqueID(module->FileName, id))
+            {
+                auto fileId = FileId(id.getDevice(), id.getFile());
+                usedModules.insert(fileId);
+                auto current = modules.find(fileId);
+                auto previous = myModulesBeforeParse.find(fileId);
+                hitCache = current != modules.end() && previous != myModulesBeforeParse.end() &&
+                    previous->second.size == current->second.size;
+            }
+            myLastParseModules.push_back(ModuleUse{ module->ModuleName, hitCache });
+        }
+    }
+    myModulesBeforeParse.clear();
+
+    uint64_t totalSize = 0;
+    for (auto &module : modules)
+    {
+        totalSize += module.second.size;
+    }
+    if (totalSize <= mySizeLimit)
+    {
+        return;
+    }
+    // The modules of the current code are kept even if they are the oldest ones, they will be needed by the next parse
+    std::vector<ModuleFile> byAge;
+    for (auto &module : modules)
+    {
+        if (usedModules.count(module.first) == 0)
+        {
+            byAge.push_back(module.second);
+        }
+    }
+    std::sort(byAge.begin(), byAge.end(), [](ModuleFile const &left, ModuleFile const &right)
+    {
+        return left.modificationTime < right.modificationTime;
+    });
+    std::cout << "Pruning the module cache" << std::endl;
+    for (auto &module : byAge)
+    {
+        if (totalSize <= mySizeLimit)
+        {
+            break;
+        }
+        if (!llvm::sys::fs::remove(module.path))
+        {
+            totalSize -= module.size;
+        }
+    }
+}
+
+bool ModuleCache::lastParseHitCache()
+{
+    return !myLastParseModules.empty() && std::all_of(myLastParseModules.begin(), myLastParseModules.end(), [](ModuleUse const &module)
+    {
+        return module.hitCache;
+    });
+}
+
+std::vector<ModuleUse> const &ModuleCache::lastParseModules()
+{
+    return myLastParseModules;
+}
+
+std::map<ModuleCache::FileId, ModuleCache::ModuleFile> ModuleCache::listModules()
+{
+    std::map<FileId, ModuleFile> result;
+    std::error_code error;
+    // Clang stores modules in one sub directory per configuration
+    for (llvm::sys::fs::recursive_directory_iterator it(myDirectory, error), end; it != end && !error; it.increment(error))
+    {
+        if (llvm::sys::path::extension(it->path()) != ".pcm")
+        {
+            continue;
+        }
+        llvm::sys::fs::file_status status;
+        if (llvm::sys::fs::status(it->path(), status) || status.type() != llvm::sys::fs::file_type::regular_file)
+        {
+            continue;
+        }
+        auto id = status.getUniqueID();
+        result[FileId(id.getDevice(), id.getFile())] = ModuleFile{ it->path(), status.getSize(), static_cast<int64_t>(status.getLastModificationTime().toEpochTime()) };
+    }
+    return result;
+}
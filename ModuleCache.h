@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <map>
+#include <utility>
+
+namespace clang
+{
+class ASTUnit;
+}
+
+struct ModuleUse
+{
+    std::string name;
+    bool hitCache; // False if it was compiled during the parse
+};
+
+// Directory where clang stores the compiled modules (-fmodules), so that system and third party headers are
+// only compiled once, and shared between all the code snippets and sessions.
+// Clang only removes modules that have not been used for a long time, the cache is additionally kept under a
+// size limit by removing the least recently written modules, except those used by the last parse.
+class ModuleCache
+{
+public:
+    ModuleCache(); // Defaults to a directory in the temporary folder
+    void setEnabled(bool enabled);
+    bool enabled();
+    void setLocation(std::string const &directory, uint64_t sizeLimit);
+    void copySettings(ModuleCache const &other);
+    std::string const &directory();
+    uint64_t sizeLimit();
+    std::vector<std::string> arguments(); // What needs to be added to the command line, empty when disabled
+    void beforeParse();
+    void afterParse(clang::ASTUnit *ast); // Also prunes the cache. ast is nullptr if the parse failed
+    bool lastParseHitCache(); // True if all the modules needed were already compiled
+    std::vector<ModuleUse> const &lastParseModules();
+private:
+    struct ModuleFile
+    {
+        std::string path;
+        uint64_t size;
+        int64_t modificationTime;
+    };
+    // Device and file (see llvm::sys::fs::UniqueID), since clang and the directory listing may spell paths differently
+    using FileId = std::pair<uint64_t, uint64_t>;
+    std::map<FileId, ModuleFile> listModules();
+    bool myEnabled;
+    std::string myDirectory;
+    uint64_t mySizeLimit;
+    std::map<FileId, ModuleFile> myModulesBeforeParse;
+    std::vector<ModuleUse> myLastParseModules;
+};
@@ -0,0 +1,259 @@
+#include "MoveAudit.h"
+#include "AstReader.h"
+#include <unordered_map>
+#include <set>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/DeclCXX.h>
+#include <clang/AST/DeclTemplate.h>
+#pragma warning (pop)
+
+using namespace clang;
+
+namespace
+{
+
+enum class MoveKind
+{
+    Construction,
+    Assignment
+};
+
+unsigned const maxDepth = 16; // Of nested members and bases, when deducing the exception specification of implicit moves
+
+CXXMethodDecl const *findMove(CXXRecordDecl const *record, MoveKind kind)
+{
+    for (auto method : record->methods())
+    {
+        auto ctor = dyn_cast<CXXConstructorDecl>(method);
+        if (kind == MoveKind::Construction ? ctor != nullptr && ctor->isMoveConstructor() : method->isMoveAssignmentOperator())
+        {
+            return method;
+        }
+    }
+    return nullptr;
+}
+
+bool needsImplicitMove(CXXRecordDecl const *record, MoveKind kind)
+{
+    return kind == MoveKind::Construction ? record->needsImplicitMoveConstructor() : record->needsImplicitMoveAssignment();
+}
+
+bool isNothrowMovable(CXXRecordDecl const *record, MoveKind kind, ASTContext &context, unsigned depth);
+
+bool isNothrowMovable(QualType type, MoveKind kind, ASTContext &context, unsigned depth)
+{
+    auto record = context.getBaseElementType(type)->getAsCXXRecordDecl();
+    return record == nullptr || isNothrowMovable(record, kind, context, depth + 1); // Scalars never throw
+}
+
+// What the compiler would deduce for an implicit or defaulted move
+bool areSubobjectsNothrowMovable(CXXRecordDecl const *record, MoveKind kind, ASTContext &context, unsigned depth)
+{
+    for (auto &base : record->bases())
+    {
+        if (!isNothrowMovable(base.getType(), kind, context, depth))
+        {
+            return false;
+        }
+    }
+    for (auto field : record->fields())
+    {
+        if (!isNothrowMovable(field->getType(), kind, context, depth))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool isNothrow(CXXMethodDecl const *move, MoveKind kind, ASTContext &context, unsigned depth)
+{
+    auto prototype = move->getType()->getAs<FunctionProtoType>();
+    if (prototype == nullptr)
+    {
+        return false;
+    }
+    auto specification = prototype->getExceptionSpecType();
+    if (specification == EST_Unevaluated || specification == EST_Uninstantiated)
+    {
+        // Clang did not need it, so it did not compute it
+        return move->isDefaulted() && areSubobjectsNothrowMovable(move->getParent(), kind, context, depth);
+    }
+    return prototype->isNothrow(context);
+}
+
+bool isNothrowMovable(CXXRecordDecl const *record, MoveKind kind, ASTContext &context, unsigned depth)
+{
+    if (depth > maxDepth || !record->hasDefinition())
+    {
+        return false;
+    }
+    if (record->isTriviallyCopyable())
+    {
+        return true;
+    }
+    if (auto move = findMove(record, kind))
+    {
+        return !move->isDeleted() && isNothrow(move, kind, context, depth);
+    }
+    if (needsImplicitMove(record, kind))
+    {
+        return areSubobjectsNothrowMovable(record, kind, context, depth);
+    }
+    return false; // Copied, and copies are rarely noexcept
+}
+
+std::string getSuppressionReason(CXXRecordDecl const *record, MoveKind kind)
+{
+    std::vector<std::string> reasons;
+    if (record->hasUserDeclaredCopyConstructor())
+    {
+        reasons.push_back("copy constructor");
+    }
+    if (record->hasUserDeclaredCopyAssignment())
+    {
+        reasons.push_back("copy assignment");
+    }
+    if (kind == MoveKind::Construction && record->hasUserDeclaredMoveAssignment())
+    {
+        reasons.push_back("move assignment");
+    }
+    if (kind == MoveKind::Assignment && record->hasUserDeclaredMoveConstructor())
+    {
+        reasons.push_back("move constructor");
+    }
+    if (record->hasUserDeclaredDestructor())
+    {
+        reasons.push_back("destructor");
+    }
+    std::string result = "Suppressed by the user-declared ";
+    for (size_t i = 0; i < reasons.size(); ++i)
+    {
+        result += (i == 0 ? "" : i + 1 == reasons.size() ? " and " : ", ") + reasons[i];
+    }
+    return result;
+}
+
+// Return the status of the move, and sets the problems found
+std::string auditMove(CXXRecordDecl const *record, MoveKind kind, ASTContext &context, std::vector<std::string> &problems)
+{
+    auto name = kind == MoveKind::Construction ? std::string("Move constructor") : std::string("Move assignment");
+    auto move = findMove(record, kind);
+    if (move != nullptr && move->isDeleted())
+    {
+        problems.push_back(name + " deleted");
+        return move->isImplicit() ? "Implicitly deleted" : "Deleted";
+    }
+    std::string status;
+    if (move != nullptr)
+    {
+        status = move->isImplicit() ? "Implicit" : move->isDefaulted() ? "Defaulted" : "User-provided";
+    }
+    else if (needsImplicitMove(record, kind))
+    {
+        // Not declared yet, because nothing used it
+        if (kind == MoveKind::Construction && !record->needsOverloadResolutionForMoveConstructor() && record->defaultedMoveConstructorIsDeleted())
+        {
+            problems.push_back(name + " deleted");
+            return "Implicitly deleted";
+        }
+        status = "Implicit";
+    }
+    else
+    {
+        problems.push_back(name + " missing, copies are used instead");
+        return getSuppressionReason(record, kind);
+    }
+    if (!isNothrowMovable(record, kind, context, 0))
+    {
+        problems.push_back(name + (kind == MoveKind::Construction ? " not noexcept, std::vector copies when reallocating" : " not noexcept"));
+    }
+    return status;
+}
+
+// Only the containers that move their elements around (reallocation, insertion in the middle). Node based
+// containers (lists, sets, maps) never relocate an element once it is constructed, how it moves does not matter
+bool isRelocatingContainer(ClassTemplateSpecializationDecl const *specialization)
+{
+    static std::set<std::string> const containers{ "vector", "deque" };
+    return specialization->isInStdNamespace() && containers.count(specialization->getName()) != 0;
+}
+
+std::string formatLocation(SourceManager &manager, SourceLocation location)
+{
+    auto presumed = manager.getPresumedLoc(manager.getExpansionLoc(location));
+    return presumed.isValid() ? std::string(presumed.getFilename()) + ":" + std::to_string(presumed.getLine()) : "";
+}
+
+} // namespace
+
+
+std::vector<MoveIssue> auditMoves(GenericAstNode *root, ASTContext &context)
+{
+    auto &manager = context.getSourceManager();
+    std::vector<std::pair<GenericAstNode *, CXXRecordDecl const *>> records;
+    std::unordered_map<Decl const *, std::vector<std::string>> containers; // By canonical declaration of the element type
+    std::vector<GenericAstNode *> toVisit{ root };
+    while (!toVisit.empty())
+    {
+        auto node = toVisit.back();
+        toVisit.pop_back();
+        for (auto &child : node->myChidren)
+        {
+            toVisit.push_back(child.get());
+        }
+        auto decl = boost::get<Decl *>(&node->myAstNode);
+        if (decl == nullptr || *decl == nullptr || manager.isInSystemHeader(manager.getExpansionLoc((*decl)->getLocation())))
+        {
+            continue;
+        }
+        if (auto record = dyn_cast<CXXRecordDecl>(*decl))
+        {
+            if (record->isCompleteDefinition() && !record->isDependentType() && !record->isInvalidDecl() && !record->isLambda() && !record->isTriviallyCopyable())
+            {
+                records.emplace_back(node, record);
+            }
+        }
+        else if (auto declarator = dyn_cast<DeclaratorDecl>(*decl))
+        {
+            auto type = declarator->getType().getNonReferenceType();
+            auto container = type.isNull() ? nullptr : dyn_cast_or_null<ClassTemplateSpecializationDecl>(type->getAsCXXRecordDecl());
+            if (container == nullptr || !isRelocatingContainer(container))
+            {
+                continue;
+            }
+            auto &arguments = container->getTemplateArgs();
+            if (arguments.size() == 0 || arguments[0].getKind() != TemplateArgument::Type)
+            {
+                continue;
+            }
+            if (auto element = arguments[0].getAsType()->getAsCXXRecordDecl())
+            {
+                containers[element->getCanonicalDecl()].push_back("std::" + container->getNameAsString() + " at " + formatLocation(manager, declarator->getLocation()));
+            }
+        }
+    }
+
+    std::vector<MoveIssue> result;
+    for (auto &record : records)
+    {
+        std::vector<std::string> problems;
+        auto moveConstructor = auditMove(record.second, MoveKind::Construction, context, problems);
+        auto moveAssignment = auditMove(record.second, MoveKind::Assignment, context, problems);
+        if (problems.empty())
+        {
+            continue;
+        }
+        std::string allProblems;
+        for (auto &problem : problems)
+        {
+            allProblems += (allProblems.empty() ? "" : "; ") + problem;
+        }
+        auto usages = containers.find(record.second->getCanonicalDecl());
+        result.push_back(MoveIssue{ record.first, record.second->getQualifiedNameAsString(), moveConstructor, moveAssignment, allProblems,
+            usages != containers.end() ? usages->second : std::vector<std::string>{} });
+    }
+    return result;
+}
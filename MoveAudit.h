@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/ASTContext.h>
+#pragma warning (pop)
+
+class GenericAstNode;
+
+// A class that standard containers will copy instead of moving (std::vector only moves its elements during a
+// reallocation if the move constructor is noexcept), or that cannot be moved at all
+struct MoveIssue
+{
+    GenericAstNode *node; // The CXXRecordDecl
+    std::string record;
+    std::string moveConstructor; // User-declared, implicit, deleted, suppressed by...
+    std::string moveAssignment;
+    std::string problems;
+    std::vector<std::string> containers; // Declarations of std::vector or std::deque of this type: "std::vector at file:line"
+};
+
+// Only the classes that are not trivially copyable, and are not declared in system headers, are audited.
+// The exception specification of implicit and defaulted moves is deduced from the bases and members when clang
+// did not need to compute it.
+std::vector<MoveIssue> auditMoves(GenericAstNode *root, clang::ASTContext &context);
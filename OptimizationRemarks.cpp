@@ -0,0 +1,111 @@
+#include "OptimizationRemarks.h"
+#include "InMemoryCompiler.h"
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/Frontend/FrontendDiagnostic.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#pragma warning (pop)
+
+using namespace clang;
+
+namespace
+{
+
+class RemarkCollector : public DiagnosticConsumer
+{
+public:
+    RemarkCollector(std::vector<OptimizationRemark> &remarks) : myRemarks(remarks)
+    {
+    }
+
+    void HandleDiagnostic(DiagnosticsEngine::Level level, Diagnostic const &info) override
+    {
+        DiagnosticConsumer::HandleDiagnostic(level, info);
+        llvm::SmallString<256> message;
+        info.FormatDiagnostic(message);
+        if (level >= DiagnosticsEngine::Error)
+        {
+            myErrors += "\n" + message.str().str();
+            return;
+        }
+        OptimizationRemark::Kind kind;
+        switch (info.getID())
+        {
+        case diag::remark_fe_backend_optimization_remark:
+            kind = OptimizationRemark::Passed;
+            break;
+        case diag::remark_fe_backend_optimization_remark_missed:
+            kind = OptimizationRemark::Missed;
+            break;
+        case diag::remark_fe_backend_optimization_remark_analysis:
+        case diag::remark_fe_backend_optimization_remark_analysis_fpcommute:
+        case diag::remark_fe_backend_optimization_remark_analysis_aliasing:
+            kind = OptimizationRemark::Analysis;
+            break;
+        default:
+            return;
+        }
+        int offset = -1;
+        std::string position;
+        if (info.getLocation().isValid() && info.hasSourceManager())
+        {
+            auto &manager = info.getSourceManager();
+            auto location = manager.getFileLoc(info.getLocation());
+            if (manager.isInMainFile(location))
+            {
+                offset = static_cast<int>(manager.getFileOffset(location));
+            }
+            auto presumed = manager.getPresumedLoc(location);
+            if (presumed.isValid())
+            {
+                position = std::string(presumed.getFilename()) + ":" + std::to_string(presumed.getLine()) + ":" + std::to_string(presumed.getColumn());
+            }
+        }
+        // The name of the pass is passed as the flag of the diagnostic (-Rpass=<pass>)
+        myRemarks.push_back(OptimizationRemark{ kind, info.getDiags()->getFlagValue().str(), message.str().str(), offset, position });
+    }
+
+    std::string const &errors() const
+    {
+        return myErrors;
+    }
+
+private:
+    std::vector<OptimizationRemark> &myRemarks;
+    std::string myErrors;
+};
+
+} // namespace
+
+
+char const *getRemarkKindName(OptimizationRemark::Kind kind)
+{
+    switch (kind)
+    {
+    case OptimizationRemark::Passed:
+        return "passed";
+    case OptimizationRemark::Missed:
+        return "missed";
+    default:
+        return "analysis";
+    }
+}
+
+bool collectOptimizationRemarks(std::string const &sourceCode, std::vector<std::string> const &args, std::string const &optimization,
+    std::vector<OptimizationRemark> &result, std::string &error)
+{
+    // The line tables are needed to locate the remarks inside the functions
+    std::vector<char const *> remarkArgs{ optimization.c_str(), "-gline-tables-only", "-gcolumn-info",
+        "-Rpass=.*", "-Rpass-missed=.*", "-Rpass-analysis=.*" };
+    RemarkCollector collector(result);
+    llvm::LLVMContext llvmContext;
+    if (compileInMemory(sourceCode, args, remarkArgs, collector, llvmContext, error) == nullptr)
+    {
+        error += collector.errors();
+        return false;
+    }
+    return true;
+}
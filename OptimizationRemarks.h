@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Remark emitted by an optimization pass (inliner, loop vectorizer, unroller...)
+struct OptimizationRemark
+{
+    enum Kind { Passed, Missed, Analysis };
+    Kind kind;
+    std::string pass;
+    std::string message;
+    int offset; // In the main file, -1 if the remark is located elsewhere
+    std::string position; // file:line:column, as reported by the compiler
+};
+
+char const *getRemarkKindName(OptimizationRemark::Kind kind);
+
+// Compiles the code with its own compiler instance, with line tables so that the remarks can be located, and
+// collects the remarks of all passes. Only the optimizer runs, the remarks of machine code generation are not
+// produced. Does not use the AST of the viewer, and can run in a background thread.
+bool collectOptimizationRemarks(std::string const &sourceCode, std::vector<std::string> const &args, std::string const &optimization,
+    std::vector<OptimizationRemark> &result, std::string &error);
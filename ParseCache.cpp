@@ -0,0 +1,157 @@
+#include "ParseCache.h"
+#include <unordered_map>
+#include <iostream>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/Basic/FileManager.h>
+#include <clang/Basic/FileSystemStatCache.h>
+#include <clang/Frontend/ChainedDiagnosticConsumer.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/FrontendAction.h>
+#include <clang/Frontend/PCHContainerOperations.h>
+#include <clang/Frontend/TextDiagnosticBuffer.h>
+#include <clang/Frontend/Utils.h>
+#include <llvm/Support/MemoryBuffer.h>
+#pragma warning (pop)
+
+struct StatCacheResults
+{
+    struct Entry
+    {
+        clang::FileSystemStatCache::LookupResult result;
+        clang::FileData data;
+    };
+    std::unordered_map<std::string, Entry> entries; // The key starts with 'f' for file lookups, and 'd' for directory lookups
+    unsigned hits = 0;
+};
+
+namespace
+{
+
+char const mainFileName[] = "input.cc"; // Same name as the one used by clang::tooling::buildASTFromCode
+
+// Syntax only, like the action ASTUnit uses by default, with a hook before the parse, but without its tracking of the
+// top level declarations
+class HookedSyntaxOnlyAction : public clang::ASTFrontendAction
+{
+public:
+    HookedSyntaxOnlyAction(std::function<void(clang::CompilerInstance &)> const &beforeParse) : myBeforeParse(beforeParse)
+    {
+    }
+    std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance &, llvm::StringRef) override
+    {
+        // With an action of its own, the ASTUnit does not track the top level declarations: top_level_begin() is empty,
+        // the tree is built from the TranslationUnitDecl instead
+        return std::make_unique<clang::ASTConsumer>();
+    }
+    bool BeginSourceFileAction(clang::CompilerInstance &instance, llvm::StringRef) override
+    {
+        if (myBeforeParse)
+        {
+            myBeforeParse(instance);
+        }
+        return true;
+    }
+private:
+    std::function<void(clang::CompilerInstance &)> const &myBeforeParse;
+};
+
+class SharedStatCache : public clang::FileSystemStatCache
+{
+public:
+    SharedStatCache(std::shared_ptr<StatCacheResults> results) : myResults(std::move(results))
+    {
+    }
+
+    LookupResult getStat(const char *path, clang::FileData &data, bool isFile, std::unique_ptr<clang::vfs::File> *file, clang::vfs::FileSystem &fs) override
+    {
+        auto key = (isFile ? 'f' : 'd') + std::string(path);
+        auto it = myResults->entries.find(key);
+        if (it != myResults->entries.end())
+        {
+            ++myResults->hits;
+            if (it->second.result == CacheExists)
+            {
+                data = it->second.data;
+            }
+            return it->second.result;
+        }
+        auto result = statChained(path, data, isFile, file, fs);
+        if (result == CacheMissing || !isFile)
+        {
+            myResults->entries.emplace(key, StatCacheResults::Entry{ result, data });
+        }
+        return result;
+    }
+
+private:
+    std::shared_ptr<StatCacheResults> myResults;
+};
+
+} // namespace
+
+
+ParseCache::ParseCache() : myStatResults(std::make_shared<StatCacheResults>())
+{
+}
+
+std::unique_ptr<clang::ASTUnit> ParseCache::buildAst(std::string const &sourceCode, std::vector<std::string> const &args, std::string &error,
+    std::function<void(clang::CompilerInstance &)> const &beforeParse)
+{
+    if (myInvocation == nullptr || args != myArgs)
+    {
+        std::cout << "Running the driver" << std::endl;
+        std::vector<char const *> commandLine{ "clang-tool", "-fsyntax-only" };
+        for (auto &arg : args)
+        {
+            commandLine.push_back(arg.c_str());
+        }
+        commandLine.push_back(mainFileName);
+        myInvocation = clang::createInvocationFromCommandLine(commandLine);
+        myArgs = args;
+        if (myInvocation == nullptr)
+        {
+            myArgs.clear();
+            error = "The command line is not valid";
+            return nullptr;
+        }
+    }
+    myStatResults->hits = 0;
+
+    // The ASTUnit modifies the invocation it works on, the template must stay untouched
+    llvm::IntrusiveRefCntPtr<clang::CompilerInvocation> invocation = new clang::CompilerInvocation(*myInvocation);
+    // The ASTUnit takes ownership of the buffer
+    invocation->getPreprocessorOpts().addRemappedFile(mainFileName, llvm::MemoryBuffer::getMemBufferCopy(sourceCode, mainFileName).release());
+    auto diagnostics = clang::CompilerInstance::createDiagnostics(&invocation->getDiagnosticOpts());
+    // Errors are still printed, but also kept in case the parse fails
+    auto errors = new clang::TextDiagnosticBuffer;
+    diagnostics->setClient(new clang::ChainedDiagnosticConsumer(diagnostics->takeClient(), std::unique_ptr<clang::DiagnosticConsumer>(errors)), true);
+    // The unit is created first, so that its FileManager can get the shared stat cache before parsing starts
+    auto unit = clang::ASTUnit::create(invocation.get(), diagnostics, false, false);
+    unit->getFileManager().addStatCache(llvm::make_unique<SharedStatCache>(myStatResults));
+    HookedSyntaxOnlyAction action(beforeParse);
+    if (clang::ASTUnit::LoadFromCompilerInvocationAction(invocation.get(), std::make_shared<clang::PCHContainerOperations>(), diagnostics, &action, unit.get()) == nullptr)
+    {
+        error = "The code could not be parsed";
+        for (auto it = errors->err_begin(); it != errors->err_end(); ++it)
+        {
+            error += "\n" + it->second;
+        }
+        return nullptr;
+    }
+    return unit;
+}
+
+void ParseCache::invalidate()
+{
+    myArgs.clear();
+    myInvocation = nullptr;
+    // ASTUnits that are still alive keep the old results
+    myStatResults = std::make_shared<StatCacheResults>();
+}
+
+unsigned ParseCache::lastSavedStats()
+{
+    return myStatResults->hits;
+}
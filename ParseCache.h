@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Frontend/CompilerInvocation.h>
+#pragma warning (pop)
+
+struct StatCacheResults;
+
+// What can be kept from one parse to the next:
+// - The compiler invocation created by the driver (toolchain detection, resource directory, header search
+//   paths...), as long as the arguments do not change. Each parse works on a copy of it.
+// - The result of the file system lookups for everything that is not a regular file: Directories, and above
+//   all files that do not exist, which is what the header search mostly looks for. Regular files are still
+//   checked every time, so that modified headers are seen.
+// Files created or deleted in the include paths are not noticed until the cache is invalidated.
+class ParseCache
+{
+public:
+    ParseCache();
+    // beforeParse is called once the preprocessor is created, but before anything is parsed (to install PPCallbacks...)
+    // Return nullptr if no AST could be built, with the reason and the errors reported by clang in error
+    std::unique_ptr<clang::ASTUnit> buildAst(std::string const &sourceCode, std::vector<std::string> const &args, std::string &error,
+        std::function<void(clang::CompilerInstance &)> const &beforeParse = nullptr);
+    void invalidate();
+    unsigned lastSavedStats(); // Number of lookups that did not reach the file system during the last parse
+private:
+    std::vector<std::string> myArgs; // Used to create myInvocation
+    llvm::IntrusiveRefCntPtr<clang::CompilerInvocation> myInvocation;
+    std::shared_ptr<StatCacheResults> myStatResults; // Shared with the FileManager of the ASTUnits that are still alive
+};
@@ -0,0 +1,323 @@
+#include "PathQuery.h"
+#include <algorithm>
+#include <cctype>
+
+namespace
+{
+
+std::string trim(std::string const &s)
+{
+    auto begin = s.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+    {
+        return std::string();
+    }
+    auto end = s.find_last_not_of(" \t");
+    return s.substr(begin, end - begin + 1);
+}
+
+// Position of the ] that closes a predicate, ignoring the ones in quoted values
+size_t findPredicateEnd(std::string const &text, size_t start)
+{
+    bool inQuotes = false;
+    for (auto i = start; i < text.size(); ++i)
+    {
+        if (text[i] == '"')
+        {
+            inQuotes = !inQuotes;
+        }
+        else if (text[i] == ']' && !inQuotes)
+        {
+            return i;
+        }
+    }
+    return std::string::npos;
+}
+
+bool isKindChar(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '*';
+}
+
+// All trees are artificial root / AST / TranslationUnitDecl / top level declarations
+bool isTopLevel(GenericAstNode const *node)
+{
+    int ancestors = 0;
+    for (auto ancestor = node->myParent; ancestor != nullptr && ancestors <= 3; ancestor = ancestor->myParent)
+    {
+        ++ancestors;
+    }
+    return ancestors == 3;
+}
+
+} // namespace
+
+
+PathIndex::PathIndex() : myArtificialRoot(nullptr), myExpansionCount(0), myHasPropertyIndex(false)
+{
+}
+
+void PathIndex::reset(GenericAstNode *artificialRoot)
+{
+    myArtificialRoot = artificialRoot;
+    myAllNodes.clear();
+    myKindIndex.clear();
+    myHasPropertyIndex = false;
+    myPropertyIndex.clear();
+}
+
+std::vector<GenericAstNode *> const &PathIndex::all()
+{
+    buildKindIndex();
+    return myAllNodes;
+}
+
+std::vector<GenericAstNode *> const &PathIndex::byKind(std::string const &kind)
+{
+    buildKindIndex();
+    auto it = myKindIndex.find(kind);
+    return it == myKindIndex.end() ? myEmpty : it->second;
+}
+
+std::vector<GenericAstNode *> const &PathIndex::byProperty(std::string const &name, std::string const &value)
+{
+    buildKindIndex();
+    if (!myHasPropertyIndex)
+    {
+        for (auto node : myAllNodes)
+        {
+            for (auto &prop : node->getProperties())
+            {
+                myPropertyIndex[prop.first + '\0' + prop.second].push_back(node);
+            }
+        }
+        myHasPropertyIndex = true;
+    }
+    auto it = myPropertyIndex.find(name + '\0' + value);
+    return it == myPropertyIndex.end() ? myEmpty : it->second;
+}
+
+void PathIndex::buildKindIndex()
+{
+    if (myArtificialRoot == nullptr || (!myAllNodes.empty() && myExpansionCount == GenericAstNode::getExpansionCount()))
+    {
+        return;
+    }
+    reset(myArtificialRoot);
+    myArtificialRoot->expandInstantiations();
+    myExpansionCount = GenericAstNode::getExpansionCount();
+    // Pre order, so that results come in the order of the tree
+    std::vector<GenericAstNode *> toVisit;
+    for (auto it = myArtificialRoot->myChidren.rbegin(); it != myArtificialRoot->myChidren.rend(); ++it)
+    {
+        toVisit.push_back(it->get());
+    }
+    while (!toVisit.empty())
+    {
+        auto node = toVisit.back();
+        toVisit.pop_back();
+        myAllNodes.push_back(node);
+        myKindIndex[node->kind].push_back(node);
+        for (auto it = node->myChidren.rbegin(); it != node->myChidren.rend(); ++it)
+        {
+            toVisit.push_back(it->get());
+        }
+    }
+}
+
+
+bool PathQuery::Predicate::matches(GenericAstNode *node) const
+{
+    auto &properties = node->getProperties();
+    auto it = properties.find(property);
+    if (it == properties.end())
+    {
+        return false;
+    }
+    switch (op)
+    {
+    case Op::Exists:
+        return true;
+    case Op::Equal:
+        return it->second == value;
+    case Op::NotEqual:
+        return it->second != value;
+    case Op::Contains:
+        return it->second.find(value) != std::string::npos;
+    case Op::StartsWith:
+        return it->second.compare(0, value.size(), value) == 0;
+    }
+    return false;
+}
+
+bool PathQuery::Step::matches(GenericAstNode *node) const
+{
+    if (!kind.empty() && node->kind != kind)
+    {
+        return false;
+    }
+    return std::all_of(predicates.begin(), predicates.end(), [node](Predicate const &p) {return p.matches(node); });
+}
+
+std::unique_ptr<PathQuery> PathQuery::compile(std::string const &text, std::string &error)
+{
+    auto query = std::make_unique<PathQuery>();
+    query->myCandidates = nullptr;
+    query->myNextCandidate = 0;
+    size_t i = 0;
+    auto skipBlanks = [&]()
+    {
+        while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i])))
+        {
+            ++i;
+        }
+    };
+    auto readAxis = [&]()
+    {
+        if (i + 1 < text.size() && text[i + 1] == '/')
+        {
+            i += 2;
+            return true;
+        }
+        ++i;
+        return false;
+    };
+
+    skipBlanks();
+    bool isDescendant = true;
+    if (i < text.size() && text[i] == '/')
+    {
+        isDescendant = readAxis();
+    }
+    while (true)
+    {
+        skipBlanks();
+        Step step;
+        step.isDescendant = isDescendant;
+        auto kindStart = i;
+        while (i < text.size() && isKindChar(text[i]))
+        {
+            ++i;
+        }
+        step.kind = text.substr(kindStart, i - kindStart);
+        if (step.kind.empty() || (step.kind != "*" && step.kind.find('*') != std::string::npos))
+        {
+            error = "Node kind or * expected at position " + std::to_string(kindStart);
+            return nullptr;
+        }
+        if (step.kind == "*")
+        {
+            step.kind.clear();
+        }
+        skipBlanks();
+        while (i < text.size() && text[i] == '[')
+        {
+            auto end = findPredicateEnd(text, i + 1);
+            if (end == std::string::npos)
+            {
+                error = "Missing ] for the predicate at position " + std::to_string(i);
+                return nullptr;
+            }
+            auto content = text.substr(i + 1, end - i - 1);
+            Predicate predicate;
+            predicate.op = Predicate::Op::Exists;
+            auto equal = content.find('=');
+            auto nameEnd = equal;
+            if (equal != std::string::npos)
+            {
+                predicate.op = Predicate::Op::Equal;
+                if (equal > 0)
+                {
+                    switch (content[equal - 1])
+                    {
+                    case '!': predicate.op = Predicate::Op::NotEqual; --nameEnd; break;
+                    case '~': predicate.op = Predicate::Op::Contains; --nameEnd; break;
+                    case '^': predicate.op = Predicate::Op::StartsWith; --nameEnd; break;
+                    }
+                }
+                predicate.value = trim(content.substr(equal + 1));
+                if (predicate.value.size() >= 2 && predicate.value.front() == '"' && predicate.value.back() == '"')
+                {
+                    predicate.value = predicate.value.substr(1, predicate.value.size() - 2);
+                }
+            }
+            predicate.property = trim(content.substr(0, nameEnd));
+            if (predicate.property.empty())
+            {
+                error = "Property name expected at position " + std::to_string(i + 1);
+                return nullptr;
+            }
+            step.predicates.push_back(predicate);
+            i = end + 1;
+            skipBlanks();
+        }
+        query->mySteps.push_back(step);
+        if (i == text.size())
+        {
+            return query;
+        }
+        if (text[i] != '/')
+        {
+            error = "/ or // expected at position " + std::to_string(i);
+            return nullptr;
+        }
+        isDescendant = readAxis();
+    }
+}
+
+void PathQuery::start(PathIndex &index)
+{
+    // The most selective index gives the candidates for the last step
+    auto &last = mySteps.back();
+    myCandidates = last.kind.empty() ? &index.all() : &index.byKind(last.kind);
+    for (auto &predicate : last.predicates)
+    {
+        if (predicate.op == Predicate::Op::Equal)
+        {
+            auto &candidates = index.byProperty(predicate.property, predicate.value);
+            if (candidates.size() < myCandidates->size())
+            {
+                myCandidates = &candidates;
+            }
+        }
+    }
+    myNextCandidate = 0;
+}
+
+bool PathQuery::run(size_t budget, std::vector<GenericAstNode *> &results)
+{
+    auto end = std::min(myCandidates->size(), myNextCandidate + budget);
+    for (; myNextCandidate != end; ++myNextCandidate)
+    {
+        auto node = (*myCandidates)[myNextCandidate];
+        if (mySteps.back().matches(node) && matchesPrefix(mySteps.size() - 1, node))
+        {
+            results.push_back(node);
+        }
+    }
+    return myNextCandidate != myCandidates->size();
+}
+
+bool PathQuery::matchesPrefix(size_t stepIndex, GenericAstNode *node) const
+{
+    // The artificial root (the only node without parent) is never part of a path
+    auto &step = mySteps[stepIndex];
+    if (stepIndex == 0)
+    {
+        return step.isDescendant || isTopLevel(node);
+    }
+    auto &previous = mySteps[stepIndex - 1];
+    if (!step.isDescendant)
+    {
+        auto parent = node->myParent;
+        return parent != nullptr && parent->myParent != nullptr && previous.matches(parent) && matchesPrefix(stepIndex - 1, parent);
+    }
+    for (auto ancestor = node->myParent; ancestor != nullptr && ancestor->myParent != nullptr; ancestor = ancestor->myParent)
+    {
+        if (previous.matches(ancestor) && matchesPrefix(stepIndex - 1, ancestor))
+        {
+            return true;
+        }
+    }
+    return false;
+}
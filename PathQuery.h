@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "AstReader.h"
+
+// Indexes of a GenericAstNode tree, built the first time they are needed. Collapsed instantiations are expanded
+// then, so that queries see their bodies. Shared type subtrees are only indexed once expanded in the view, and
+// the indexes are built again when a query starts after nodes have been added by an expansion.
+class PathIndex
+{
+public:
+    PathIndex();
+    void reset(GenericAstNode *artificialRoot);
+    std::vector<GenericAstNode *> const &all();
+    std::vector<GenericAstNode *> const &byKind(std::string const &kind);
+    std::vector<GenericAstNode *> const &byProperty(std::string const &name, std::string const &value);
+private:
+    void buildKindIndex();
+    GenericAstNode *myArtificialRoot;
+    unsigned myExpansionCount; // GenericAstNode::getExpansionCount() when the indexes were built
+    std::vector<GenericAstNode *> myAllNodes; // Empty until the kind index is built
+    std::unordered_map<std::string, std::vector<GenericAstNode *>> myKindIndex;
+    bool myHasPropertyIndex;
+    std::unordered_map<std::string, std::vector<GenericAstNode *>> myPropertyIndex; // Key is name + '\0' + value
+    std::vector<GenericAstNode *> myEmpty;
+};
+
+// A small XPath-like language over node kinds and properties, that works on any tree, live, detached or loaded
+// from a snapshot. For instance:
+//     FunctionDecl//DeclRefExpr[Referenced name~=printf]
+// - A path is a list of steps separated by / (child) or // (descendant). It may start with / to be anchored
+//   at the top level declarations (the children of the TranslationUnitDecl), otherwise the first step can be
+//   anywhere in the tree. For instance /FunctionDecl only finds the functions that are not in a namespace or a class.
+// - A step is a node kind (the class of the node, without the name displayed after it in the tree), or * for
+//   any kind, followed by any number of predicates on properties:
+//   [Prop] (exists), [Prop=value], [Prop!=value], [Prop~=value] (contains), [Prop^=value] (starts with).
+//   Values can be quoted.
+// The query is compiled into a plan: Candidates for the last step come from the most selective index (kind or
+// property value), then each candidate is checked against the previous steps by walking up to its ancestors.
+class PathQuery
+{
+public:
+    static std::unique_ptr<PathQuery> compile(std::string const &text, std::string &error); // Return nullptr on error
+    void start(PathIndex &index);
+    // Check at most budget candidates, and add those that match to results. Return false when all have been checked
+    bool run(size_t budget, std::vector<GenericAstNode *> &results);
+private:
+    struct Predicate
+    {
+        enum class Op { Exists, Equal, NotEqual, Contains, StartsWith };
+        std::string property;
+        Op op;
+        std::string value;
+        bool matches(GenericAstNode *node) const;
+    };
+    struct Step
+    {
+        std::string kind; // Empty for *
+        std::vector<Predicate> predicates;
+        bool isDescendant; // Relation with the previous step, or with the root for the first one
+        bool matches(GenericAstNode *node) const;
+    };
+    bool matchesPrefix(size_t stepIndex, GenericAstNode *node) const; // Node matches mySteps[stepIndex], do the previous steps match?
+    std::vector<Step> mySteps;
+    std::vector<GenericAstNode *> const *myCandidates;
+    size_t myNextCandidate;
+};
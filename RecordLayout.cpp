@@ -0,0 +1,195 @@
+#include "RecordLayout.h"
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/DeclCXX.h>
+#include <clang/AST/RecordLayout.h>
+#include <clang/Basic/TargetInfo.h>
+#pragma warning (pop)
+
+using namespace clang;
+
+namespace
+{
+
+// Offsets and sizes in bits, for bit-fields
+struct LayoutElement
+{
+    uint64_t offset;
+    uint64_t size;
+    std::string description;
+};
+
+bool collectElements(RecordDecl const *record, ASTContext &context, std::vector<LayoutElement> &elements)
+{
+    if (record->isInvalidDecl() || !record->isCompleteDefinition() || record->isDependentType())
+    {
+        return false;
+    }
+    auto &layout = context.getASTRecordLayout(record);
+    uint64_t charWidth = context.getCharWidth();
+    uint64_t pointerWidth = context.getTargetInfo().getPointerWidth(0);
+    if (auto cxxRecord = dyn_cast<CXXRecordDecl>(record))
+    {
+        if (layout.hasOwnVFPtr())
+        {
+            elements.push_back(LayoutElement{ 0, pointerWidth, "<virtual table pointer>" });
+        }
+        if (layout.hasOwnVBPtr()) // Microsoft ABI only
+        {
+            elements.push_back(LayoutElement{ layout.getVBPtrOffset().getQuantity() * charWidth, pointerWidth, "<virtual base table pointer>" });
+        }
+        for (auto &base : cxxRecord->bases())
+        {
+            auto baseRecord = base.getType()->getAsCXXRecordDecl();
+            if (base.isVirtual() || baseRecord == nullptr)
+            {
+                continue;
+            }
+            auto size = baseRecord->isEmpty() ? 0 : context.getASTRecordLayout(baseRecord).getNonVirtualSize().getQuantity() * charWidth;
+            elements.push_back(LayoutElement{ layout.getBaseClassOffset(baseRecord).getQuantity() * charWidth, size, "base " + base.getType().getAsString() });
+        }
+        for (auto &base : cxxRecord->vbases())
+        {
+            auto baseRecord = base.getType()->getAsCXXRecordDecl();
+            if (baseRecord == nullptr)
+            {
+                continue;
+            }
+            auto size = baseRecord->isEmpty() ? 0 : context.getASTRecordLayout(baseRecord).getNonVirtualSize().getQuantity() * charWidth;
+            elements.push_back(LayoutElement{ layout.getVBaseClassOffset(baseRecord).getQuantity() * charWidth, size, "virtual base " + base.getType().getAsString() });
+        }
+    }
+    unsigned index = 0;
+    for (auto field : record->fields())
+    {
+        uint64_t size = field->isBitField() ? field->getBitWidthValue(context) :
+            field->getType()->isIncompleteArrayType() ? 0 : // Flexible array member
+            context.getTypeSize(field->getType());
+        elements.push_back(LayoutElement{ layout.getFieldOffset(index++), size, field->getType().getAsString() + " " + field->getNameAsString() });
+    }
+    std::stable_sort(elements.begin(), elements.end(), [](LayoutElement const &e1, LayoutElement const &e2) {return e1.offset < e2.offset; });
+    return true;
+}
+
+std::string formatBits(uint64_t bits, uint64_t charWidth)
+{
+    return bits % charWidth == 0 ?
+        std::to_string(bits / charWidth) :
+        std::to_string(bits / charWidth) + ":" + std::to_string(bits % charWidth);
+}
+
+// Computes the padding, and describes the layout if out is not nullptr
+bool analyzeLayout(RecordDecl const *record, ASTContext &context, unsigned cacheLineSize, RecordPadding &result, std::ostream *out)
+{
+    std::vector<LayoutElement> elements;
+    if (!collectElements(record, context, elements))
+    {
+        return false;
+    }
+    auto &layout = context.getASTRecordLayout(record);
+    uint64_t charWidth = context.getCharWidth();
+    uint64_t sizeBits = layout.getSize().getQuantity() * charWidth;
+    uint64_t lineBits = std::max(1u, cacheLineSize) * charWidth;
+    result = RecordPadding{ static_cast<uint64_t>(layout.getSize().getQuantity()), static_cast<uint64_t>(layout.getAlignment().getQuantity()), 0, 0, 0, 0 };
+    result.cacheLines = static_cast<unsigned>((sizeBits + lineBits - 1) / lineBits);
+
+    if (out != nullptr)
+    {
+        *out << "Size: " << result.size << " bytes, alignment: " << result.alignment << " bytes\n\n";
+        *out << std::setw(8) << "Offset" << std::setw(8) << "Size" << "  Member\n";
+    }
+    uint64_t coveredEnd = 0; // Subobjects can overlap (unions, tail padding of bases)
+    uint64_t coveredBits = 0;
+    uint64_t dataBits = 0;
+    uint64_t nextLine = lineBits;
+    auto printLines = [&](uint64_t offset)
+    {
+        for (; out != nullptr && nextLine <= offset && nextLine < sizeBits; nextLine += lineBits)
+        {
+            *out << "--- cache line " << nextLine / lineBits << ", offset " << nextLine / charWidth << " ---\n";
+        }
+    };
+    auto printHole = [&](uint64_t begin, uint64_t end)
+    {
+        printLines(begin);
+        if (out != nullptr)
+        {
+            *out << std::setw(8) << formatBits(begin, charWidth) << std::setw(8) << formatBits(end - begin, charWidth) << "  <padding>\n";
+        }
+    };
+    for (auto &element : elements)
+    {
+        if (element.offset > coveredEnd)
+        {
+            printHole(coveredEnd, element.offset);
+        }
+        auto end = element.offset + element.size;
+        auto crosses = element.size > 0 && element.offset / lineBits != (end - 1) / lineBits;
+        if (crosses)
+        {
+            ++result.crossingMembers;
+        }
+        printLines(element.offset);
+        if (out != nullptr)
+        {
+            *out << std::setw(8) << formatBits(element.offset, charWidth) << std::setw(8) << formatBits(element.size, charWidth)
+                << "  " << element.description << (crosses ? "  (crosses a cache line boundary)" : "") << "\n";
+        }
+        if (end > coveredEnd)
+        {
+            coveredBits += end - std::max(coveredEnd, element.offset);
+            coveredEnd = end;
+        }
+        dataBits += element.size;
+    }
+    if (sizeBits > coveredEnd && !elements.empty())
+    {
+        printHole(coveredEnd, sizeBits);
+    }
+
+    // Empty records are not padded, they just need an address
+    result.padding = elements.empty() ? 0 : (sizeBits - coveredBits) / charWidth;
+    if (record->isUnion() || elements.empty())
+    {
+        result.reorderedSize = result.size;
+    }
+    else
+    {
+        auto dataSize = (dataBits + charWidth - 1) / charWidth;
+        result.reorderedSize = std::min(result.size, (dataSize + result.alignment - 1) / result.alignment * result.alignment);
+    }
+
+    if (out != nullptr)
+    {
+        *out << "\nPadding: " << result.padding << " bytes\n";
+        *out << "Size with the members sorted by decreasing alignment: " << result.reorderedSize << " bytes ("
+            << result.size - result.reorderedSize << " bytes saved)\n";
+        *out << "Cache lines of " << cacheLineSize << " bytes: " << result.cacheLines
+            << ", members crossing a boundary: " << result.crossingMembers << "\n";
+    }
+    return true;
+}
+
+} // namespace
+
+
+bool computeRecordPadding(RecordDecl const *record, ASTContext &context, unsigned cacheLineSize, RecordPadding &result)
+{
+    return analyzeLayout(record, context, cacheLineSize, result, nullptr);
+}
+
+std::string describeRecordLayout(RecordDecl const *record, ASTContext &context, unsigned cacheLineSize)
+{
+    std::ostringstream out;
+    RecordPadding padding;
+    if (!analyzeLayout(record, context, cacheLineSize, padding, &out))
+    {
+        return "";
+    }
+    return out.str();
+}
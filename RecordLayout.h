@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/ASTContext.h>
+#pragma warning (pop)
+
+// Sizes are in bytes
+struct RecordPadding
+{
+    uint64_t size;
+    uint64_t alignment;
+    uint64_t padding; // Holes between the subobjects, and tail padding
+    uint64_t reorderedSize; // With the members sorted by decreasing alignment, see describeRecordLayout
+    unsigned cacheLines;
+    unsigned crossingMembers; // Members that straddle a cache line boundary
+};
+
+// Return false if the record has no layout (incomplete, dependent or invalid)
+bool computeRecordPadding(clang::RecordDecl const *record, clang::ASTContext &context, unsigned cacheLineSize, RecordPadding &result);
+// Offsets and sizes of the virtual table pointer, bases and fields, with the padding holes and the cache line
+// boundaries. The size after reordering is an estimate: Bases and virtual table pointers cannot actually be moved
+// after the fields, and bit-fields are packed together.
+std::string describeRecordLayout(clang::RecordDecl const *record, clang::ASTContext &context, unsigned cacheLineSize);
@@ -0,0 +1,186 @@
+#include "StallWatchdog.h"
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <algorithm>
+
+namespace
+{
+
+size_t const maxLogSize = 1000;
+// Upper bounds of the buckets of the histogram, in milliseconds. The last bucket has no bound.
+std::vector<unsigned> const histogramBounds{ 100, 250, 500, 1000, 2000, 5000, 10000 };
+char const *const unknownActivity = "Event processing (no marked slot)";
+
+size_t getBucket(unsigned milliseconds)
+{
+    return std::upper_bound(histogramBounds.begin(), histogramBounds.end(), milliseconds) - histogramBounds.begin();
+}
+
+std::string getBucketName(size_t bucket)
+{
+    if (bucket == 0)
+    {
+        return "< " + std::to_string(histogramBounds[0]) + " ms";
+    }
+    if (bucket == histogramBounds.size())
+    {
+        return ">= " + std::to_string(histogramBounds.back()) + " ms";
+    }
+    return std::to_string(histogramBounds[bucket - 1]) + " - " + std::to_string(histogramBounds[bucket]) + " ms";
+}
+
+std::string formatLocalTime(std::chrono::system_clock::time_point time)
+{
+    auto seconds = std::chrono::system_clock::to_time_t(time);
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), "%H:%M:%S", std::localtime(&seconds));
+    return buffer;
+}
+
+} // namespace
+
+
+StallWatchdog::StallWatchdog() :
+    myLastBeat(now()),
+    myThreshold(0),
+    myActivity(nullptr),
+    mySampledActivity(nullptr),
+    myIsStallReported(false),
+    myTreeSize(0),
+    myHistogram(histogramBounds.size() + 1, 0),
+    myStop(false)
+{
+}
+
+StallWatchdog::~StallWatchdog()
+{
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+        myStop = true;
+    }
+    myWakeUp.notify_all();
+    if (myThread.joinable())
+    {
+        myThread.join();
+    }
+}
+
+void StallWatchdog::start(unsigned thresholdMilliseconds)
+{
+    setThreshold(thresholdMilliseconds);
+    myLastBeat = now();
+    if (!myThread.joinable())
+    {
+        myThread = std::thread([this]() {watch(); });
+    }
+}
+
+void StallWatchdog::setThreshold(unsigned milliseconds)
+{
+    myThreshold = std::max(milliseconds, 1u);
+}
+
+unsigned StallWatchdog::getThreshold() const
+{
+    return myThreshold;
+}
+
+uint64_t StallWatchdog::now()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void StallWatchdog::beat()
+{
+    auto current = now();
+    auto blocked = static_cast<unsigned>(current - myLastBeat.exchange(current));
+    auto sampled = mySampledActivity.exchange(nullptr);
+    myIsStallReported = false;
+    if (blocked < myThreshold)
+    {
+        return;
+    }
+    auto start = std::chrono::system_clock::now() - std::chrono::milliseconds(blocked);
+    std::lock_guard<std::mutex> lock(myMutex);
+    myLog.push_back(Stall{ formatLocalTime(start), sampled != nullptr ? sampled : unknownActivity, blocked, myTreeSize });
+    if (myLog.size() > maxLogSize)
+    {
+        myLog.pop_front();
+    }
+    ++myHistogram[getBucket(blocked)];
+}
+
+void StallWatchdog::setTreeSize(size_t nodes)
+{
+    myTreeSize = nodes;
+}
+
+void StallWatchdog::addToTreeSize(size_t nodes)
+{
+    myTreeSize += nodes;
+}
+
+AnalysisReport StallWatchdog::getReport()
+{
+    AnalysisReport report;
+    report.title = "Stalls of the event loop (threshold " + std::to_string(myThreshold) + " ms)";
+    report.headers = { "Duration / Time", "Stalls / Activity", "Blocked (ms)", "Tree size" };
+    std::lock_guard<std::mutex> lock(myMutex);
+    for (size_t bucket = 0; bucket < myHistogram.size(); ++bucket)
+    {
+        AnalysisReport::Row group{ nullptr, { getBucketName(bucket), std::to_string(myHistogram[bucket]), "", "" }, {} };
+        // Most recent first
+        for (auto stall = myLog.rbegin(); stall != myLog.rend(); ++stall)
+        {
+            if (getBucket(stall->milliseconds) == bucket)
+            {
+                group.children.push_back(AnalysisReport::Row{ nullptr,
+                    { stall->time, stall->activity, std::to_string(stall->milliseconds), std::to_string(stall->treeSize) }, {} });
+            }
+        }
+        report.rows.push_back(std::move(group));
+    }
+    return report;
+}
+
+void StallWatchdog::watch()
+{
+    std::unique_lock<std::mutex> lock(myMutex);
+    while (!myStop)
+    {
+        // Sampling several times per threshold, so that the activity is seen while it blocks
+        auto threshold = myThreshold.load();
+        myWakeUp.wait_for(lock, std::chrono::milliseconds(std::max(threshold / 4, 1u)));
+        auto blocked = now() - myLastBeat;
+        if (myStop || blocked < threshold)
+        {
+            continue;
+        }
+        auto activity = myActivity.load();
+        if (activity != nullptr)
+        {
+            mySampledActivity = activity;
+        }
+        else
+        {
+            char const *expected = nullptr;
+            mySampledActivity.compare_exchange_strong(expected, unknownActivity);
+        }
+        if (!myIsStallReported.exchange(true))
+        {
+            std::cout << "Event loop blocked for more than " << blocked << " ms in " << (activity != nullptr ? activity : unknownActivity) << std::endl;
+        }
+    }
+}
+
+StallWatchdog::Activity::Activity(StallWatchdog &watchdog, char const *name) :
+    myWatchdog(watchdog),
+    myPrevious(watchdog.myActivity.exchange(name))
+{
+}
+
+StallWatchdog::Activity::~Activity()
+{
+    myWatchdog.myActivity = myPrevious;
+}
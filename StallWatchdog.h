@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include "AnalysisReport.h"
+
+// Period during which the event loop did not run
+struct Stall
+{
+    std::string time; // When it started, local time
+    std::string activity; // Innermost slot marked as running, if any
+    unsigned milliseconds;
+    size_t treeSize; // Nodes in the displayed tree
+};
+
+// Notices when the event loop is blocked. The event loop calls beat() regularly (from a timer), and a
+// watchdog thread checks that the beats keep coming. When they do not, the thread samples the activity
+// that was running, since it has usually ended by the time the event loop runs again. Each stall is logged
+// to the console while it happens (in case it never ends), then recorded when the next beat comes.
+class StallWatchdog
+{
+public:
+    StallWatchdog();
+    ~StallWatchdog(); // Stops the thread
+    void start(unsigned thresholdMilliseconds);
+    void setThreshold(unsigned milliseconds);
+    unsigned getThreshold() const;
+    void beat(); // From the event loop thread
+    void setTreeSize(size_t nodes);
+    void addToTreeSize(size_t nodes); // When nodes are expanded
+    // The stalls in the log (the last ones), grouped by duration, with how many stalls each group had since the start
+    AnalysisReport getReport();
+
+    // Marks what the event loop thread is running, for the duration of a scope. name must be a string literal.
+    class Activity
+    {
+    public:
+        Activity(StallWatchdog &watchdog, char const *name);
+        ~Activity();
+        Activity(Activity const &) = delete;
+        Activity &operator=(Activity const &) = delete;
+    private:
+        StallWatchdog &myWatchdog;
+        char const *myPrevious;
+    };
+
+private:
+    void watch();
+    static uint64_t now(); // In milliseconds
+    std::atomic<uint64_t> myLastBeat;
+    std::atomic<unsigned> myThreshold;
+    std::atomic<char const *> myActivity;
+    std::atomic<char const *> mySampledActivity; // During the current stall, nullptr if none
+    std::atomic<bool> myIsStallReported; // To the console, once per stall
+    std::atomic<size_t> myTreeSize;
+    std::mutex myMutex; // For what follows
+    std::deque<Stall> myLog;
+    std::vector<unsigned> myHistogram; // Stalls since the start, by bucket of duration
+    bool myStop;
+    std::condition_variable myWakeUp;
+    std::thread myThread; // Last member, started once everything else is initialized
+};
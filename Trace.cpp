@@ -0,0 +1,175 @@
+#include "Trace.h"
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+
+namespace trace
+{
+
+std::atomic<bool> recording(false);
+
+namespace
+{
+
+size_t const maxDetailSize = 63;
+
+// A slot is written by the thread that reserved its index. Its sequence is 0 while it is written, then the
+// index + 1, so that a reader can tell if it read a complete event.
+struct Slot
+{
+    std::atomic<uint64_t> sequence;
+    std::atomic<char const *> name;
+    std::atomic<uint64_t> start;
+    std::atomic<uint64_t> duration;
+    std::atomic<uint32_t> thread;
+    char detail[maxDetailSize + 1];
+};
+
+template<size_t capacity> // Power of two
+struct Ring
+{
+    Slot slots[capacity];
+    std::atomic<uint64_t> nextIndex;
+
+    Slot &reserve(uint64_t &index)
+    {
+        index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+        return slots[index & (capacity - 1)];
+    }
+};
+
+Ring<1 << 16> mainBuffer;
+Ring<1 << 14> frequentBuffer;
+
+auto const startTime = std::chrono::steady_clock::now();
+
+uint32_t currentThread()
+{
+    static std::atomic<uint32_t> threadCount(0);
+    thread_local uint32_t const thread = ++threadCount;
+    return thread;
+}
+
+void writeJsonString(std::ostream &out, char const *text)
+{
+    out << '"';
+    for (; *text != '\0'; ++text)
+    {
+        auto c = *text;
+        if (c == '"' || c == '\\')
+        {
+            out << '\\' << c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            out << ' ';
+        }
+        else
+        {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+template<size_t capacity>
+void writeEvents(std::ostream &out, Ring<capacity> &ring, bool &first)
+{
+    auto end = ring.nextIndex.load(std::memory_order_acquire);
+    auto begin = end > capacity ? end - capacity : 0;
+    for (auto index = begin; index < end; ++index)
+    {
+        auto &slot = ring.slots[index & (capacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != index + 1)
+        {
+            continue; // Being written, or already overwritten
+        }
+        auto name = slot.name.load(std::memory_order_relaxed);
+        auto start = slot.start.load(std::memory_order_relaxed);
+        auto duration = slot.duration.load(std::memory_order_relaxed);
+        auto thread = slot.thread.load(std::memory_order_relaxed);
+        char detail[maxDetailSize + 1];
+        std::memcpy(detail, slot.detail, sizeof(detail));
+        detail[maxDetailSize] = '\0';
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != index + 1)
+        {
+            continue; // Overwritten while it was read
+        }
+        out << (first ? "\n" : ",\n") << "{\"name\":";
+        writeJsonString(out, name);
+        out << ",\"cat\":\"viewer\",\"ph\":\"X\",\"ts\":" << start << ",\"dur\":" << duration << ",\"pid\":1,\"tid\":" << thread;
+        if (detail[0] != '\0')
+        {
+            out << ",\"args\":{\"detail\":";
+            writeJsonString(out, detail);
+            out << "}";
+        }
+        out << "}";
+        first = false;
+    }
+}
+
+template<size_t capacity>
+void clearEvents(Ring<capacity> &ring)
+{
+    ring.nextIndex.store(0, std::memory_order_release);
+    for (auto &slot : ring.slots)
+    {
+        slot.sequence.store(0, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+
+void setRecording(bool record)
+{
+    recording.store(record, std::memory_order_relaxed);
+}
+
+uint64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void record(Buffer buffer, char const *name, char const *detail, uint64_t start, uint64_t duration)
+{
+    uint64_t index;
+    auto &slot = buffer == Buffer::Frequent ? frequentBuffer.reserve(index) : mainBuffer.reserve(index);
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.duration.store(duration, std::memory_order_relaxed);
+    slot.thread.store(currentThread(), std::memory_order_relaxed);
+    auto detailSize = std::min(std::strlen(detail), maxDetailSize);
+    std::memcpy(slot.detail, detail, detailSize);
+    slot.detail[detailSize] = '\0';
+    slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+bool save(std::string const &fileName)
+{
+    std::ofstream out(fileName);
+    if (!out)
+    {
+        return false;
+    }
+    // The viewer sorts the events, they do not need to be merged
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    writeEvents(out, mainBuffer, first);
+    writeEvents(out, frequentBuffer, first);
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return static_cast<bool>(out);
+}
+
+void clear()
+{
+    clearEvents(mainBuffer);
+    clearEvents(frequentBuffer);
+}
+
+} // namespace trace
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <atomic>
+#include <cstdint>
+
+// Timeline of what the viewer does, for diagnosing stalls. Scopes are recorded in a fixed size ring buffer
+// (the oldest events are overwritten) that any thread can write to without locking, and that can be saved
+// in the Chrome trace event format (open it in chrome://tracing). When recording is off, a scope costs one
+// relaxed atomic load.
+// Scopes that run thousands of times per second (the views querying the model...) go to a buffer of their own,
+// so that they do not push everything else out of the main one.
+namespace trace
+{
+
+extern std::atomic<bool> recording;
+
+inline bool isRecording()
+{
+    return recording.load(std::memory_order_relaxed);
+}
+
+enum class Buffer
+{
+    Main,
+    Frequent
+};
+
+void setRecording(bool record);
+uint64_t now(); // In microseconds
+// name must be a string literal, or at least outlive the buffer. detail is copied, and truncated.
+void record(Buffer buffer, char const *name, char const *detail, uint64_t start, uint64_t duration);
+bool save(std::string const &fileName); // Events currently in the buffers, oldest first
+void clear();
+
+class Scope
+{
+public:
+    // Nothing is recorded if name is nullptr
+    explicit Scope(char const *name, Buffer buffer = Buffer::Main) : myName(isRecording() ? name : nullptr), myBuffer(buffer), myStart(0)
+    {
+        if (myName != nullptr)
+        {
+            myStart = now();
+        }
+    }
+    ~Scope()
+    {
+        if (myName != nullptr)
+        {
+            record(myBuffer, myName, "", myStart, now() - myStart);
+        }
+    }
+    Scope(Scope const &) = delete;
+    Scope &operator=(Scope const &) = delete;
+private:
+    char const *myName;
+    Buffer myBuffer;
+    uint64_t myStart;
+};
+
+// A scope with a detail (the declaration being visited...), for the places that are not hot enough for the
+// cost of building it to matter. The detail is only kept when recording.
+class DetailScope
+{
+public:
+    // Nothing is recorded if name is nullptr
+    DetailScope(char const *name, std::string detail) : myName(isRecording() ? name : nullptr), myStart(0)
+    {
+        if (myName != nullptr)
+        {
+            myDetail = std::move(detail);
+            myStart = now();
+        }
+    }
+    ~DetailScope()
+    {
+        if (myName != nullptr)
+        {
+            record(Buffer::Main, myName, myDetail.c_str(), myStart, now() - myStart);
+        }
+    }
+    DetailScope(DetailScope const &) = delete;
+    DetailScope &operator=(DetailScope const &) = delete;
+private:
+    char const *myName;
+    std::string myDetail;
+    uint64_t myStart;
+};
+
+} // namespace trace
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_FREQUENT_SCOPE(name) trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name, trace::Buffer::Frequent)
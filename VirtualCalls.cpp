@@ -0,0 +1,190 @@
+#include "VirtualCalls.h"
+#include "AstReader.h"
+#include "CfgLoops.h"
+#include <sstream>
+#include <set>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/ExprCXX.h>
+#include <clang/AST/DeclCXX.h>
+#include <clang/AST/VTableBuilder.h>
+#include <clang/AST/Attr.h>
+#pragma warning (pop)
+
+using namespace clang;
+
+namespace
+{
+
+// Objects that are not accessed through a pointer or a reference
+bool hasKnownDynamicType(Expr const *object, bool isArrow)
+{
+    object = object->IgnoreParenImpCasts();
+    if (isArrow)
+    {
+        // (&local)->f()
+        auto addressOf = dyn_cast<UnaryOperator>(object);
+        if (addressOf == nullptr || addressOf->getOpcode() != UO_AddrOf)
+        {
+            return false;
+        }
+        object = addressOf->getSubExpr()->IgnoreParenImpCasts();
+    }
+    if (auto ref = dyn_cast<DeclRefExpr>(object))
+    {
+        auto variable = dyn_cast<VarDecl>(ref->getDecl());
+        return variable != nullptr && !variable->getType()->isReferenceType();
+    }
+    if (auto member = dyn_cast<MemberExpr>(object))
+    {
+        auto field = dyn_cast<FieldDecl>(member->getMemberDecl());
+        return field != nullptr && !field->getType()->isReferenceType();
+    }
+    return isa<MaterializeTemporaryExpr>(object) || isa<CXXTemporaryObjectExpr>(object) || isa<CXXConstructExpr>(object);
+}
+
+// Return an empty string if the call must be dispatched
+std::string getDevirtualizationReason(CXXMemberCallExpr const *call, CXXMethodDecl const *method, MemberExpr const *callee)
+{
+    if (method->hasAttr<FinalAttr>())
+    {
+        return "Final method";
+    }
+    auto objectType = call->getImplicitObjectArgument()->getType();
+    if (objectType->isPointerType())
+    {
+        objectType = objectType->getPointeeType();
+    }
+    auto record = objectType->getAsCXXRecordDecl();
+    if (record != nullptr && record->hasDefinition())
+    {
+        if (record->hasAttr<FinalAttr>())
+        {
+            return "Final class " + record->getQualifiedNameAsString();
+        }
+        auto overrider = method->getCorrespondingMethodInClass(record);
+        if (overrider != nullptr && overrider->hasAttr<FinalAttr>())
+        {
+            return "Final overrider in " + record->getQualifiedNameAsString();
+        }
+    }
+    if (hasKnownDynamicType(call->getImplicitObjectArgument(), callee->isArrow()))
+    {
+        return "Known dynamic type";
+    }
+    return "";
+}
+
+void describeComponent(std::ostream &out, VTableComponent const &component)
+{
+    switch (component.getKind())
+    {
+    case VTableComponent::CK_VCallOffset:
+        out << "vcall offset " << component.getVCallOffset().getQuantity();
+        break;
+    case VTableComponent::CK_VBaseOffset:
+        out << "vbase offset " << component.getVBaseOffset().getQuantity();
+        break;
+    case VTableComponent::CK_OffsetToTop:
+        out << "offset to top " << component.getOffsetToTop().getQuantity();
+        break;
+    case VTableComponent::CK_RTTI:
+        out << "RTTI " << component.getRTTIDecl()->getQualifiedNameAsString();
+        break;
+    case VTableComponent::CK_FunctionPointer:
+        out << component.getFunctionDecl()->getQualifiedNameAsString() << (component.getFunctionDecl()->isPure() ? " [pure]" : "");
+        break;
+    case VTableComponent::CK_CompleteDtorPointer:
+        out << component.getDestructorDecl()->getQualifiedNameAsString() << " [complete]";
+        break;
+    case VTableComponent::CK_DeletingDtorPointer:
+        out << component.getDestructorDecl()->getQualifiedNameAsString() << " [deleting]";
+        break;
+    case VTableComponent::CK_UnusedFunctionPointer:
+        out << component.getUnusedFunctionDecl()->getQualifiedNameAsString() << " [unused]";
+        break;
+    }
+}
+
+void describeLayout(std::ostream &out, VTableLayout const &layout)
+{
+    std::set<uint64_t> addressPoints;
+    for (auto &addressPoint : layout.getAddressPoints())
+    {
+        addressPoints.insert(addressPoint.second);
+    }
+    uint64_t index = 0;
+    for (auto &component : layout.vtable_components())
+    {
+        out << (addressPoints.count(index) != 0 ? "-> " : "   ") << index << ": ";
+        describeComponent(out, component);
+        out << "\n";
+        ++index;
+    }
+}
+
+} // namespace
+
+
+std::vector<VirtualCallSite> findVirtualCalls(GenericAstNode *root, ASTContext &context)
+{
+    auto &manager = context.getSourceManager();
+    LoopDepthFinder depthFinder(context);
+    std::vector<VirtualCallSite> result;
+    std::vector<GenericAstNode *> toVisit{ root };
+    while (!toVisit.empty())
+    {
+        auto node = toVisit.back();
+        toVisit.pop_back();
+        for (auto &child : node->myChidren)
+        {
+            toVisit.push_back(child.get());
+        }
+        auto stmt = boost::get<Stmt *>(&node->myAstNode);
+        auto call = stmt != nullptr ? dyn_cast_or_null<CXXMemberCallExpr>(*stmt) : nullptr;
+        auto method = call != nullptr ? call->getMethodDecl() : nullptr;
+        auto callee = call != nullptr ? dyn_cast<MemberExpr>(call->getCallee()->IgnoreParens()) : nullptr;
+        if (method == nullptr || !method->isVirtual() || callee == nullptr || callee->hasQualifier())
+        {
+            continue;
+        }
+        auto location = manager.getExpansionLoc(call->getLocStart());
+        if (!manager.isInMainFile(location))
+        {
+            continue;
+        }
+        auto reason = getDevirtualizationReason(call, method, callee);
+        std::string function;
+        auto depth = depthFinder.getLoopDepth(node, function);
+        result.push_back(VirtualCallSite{ node, method->getQualifiedNameAsString(),
+            reason.empty() ? "Virtual dispatch" : "Devirtualizable: " + reason, !reason.empty(), depth, function,
+            std::to_string(manager.getExpansionLineNumber(location)) + ":" + std::to_string(manager.getExpansionColumnNumber(location)) });
+    }
+    return result;
+}
+
+std::string describeVTableLayout(CXXRecordDecl const *record, ASTContext &context)
+{
+    if (!record->isCompleteDefinition() || record->isDependentType() || record->isInvalidDecl() || !record->isDynamicClass())
+    {
+        return "";
+    }
+    std::ostringstream out;
+    auto vtableContext = context.getVTableContext();
+    if (auto itanium = dyn_cast<ItaniumVTableContext>(vtableContext))
+    {
+        out << "Virtual table of " << record->getQualifiedNameAsString() << " (-> marks the address points)\n";
+        describeLayout(out, itanium->getVTableLayout(record));
+    }
+    else if (auto microsoft = dyn_cast<MicrosoftVTableContext>(vtableContext))
+    {
+        // One table per virtual function table pointer
+        for (auto &info : microsoft->getVFPtrOffsets(record))
+        {
+            out << "Virtual function table of " << record->getQualifiedNameAsString() << " at offset " << info->FullOffsetInMDC.getQuantity() << "\n";
+            describeLayout(out, microsoft->getVFTableLayout(record, info->FullOffsetInMDC));
+        }
+    }
+    return out.str();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#pragma warning (push)
+#pragma warning (disable:4100 4127 4800 4512 4245 4291 4510 4610 4324 4267 4244 4996)
+#include <clang/AST/ASTContext.h>
+#pragma warning (pop)
+
+class GenericAstNode;
+
+struct VirtualCallSite
+{
+    GenericAstNode *node; // The CXXMemberCallExpr
+    std::string callee; // Qualified name of the method named in the call
+    std::string verdict; // Why the call can be devirtualized, or "Virtual dispatch"
+    bool devirtualizable;
+    unsigned loopDepth; // See CfgLoops.h
+    std::string function; // The enclosing function
+    std::string position; // line:column
+};
+
+// Calls of virtual methods in the main file, except the qualified ones (Base::f()) that are not dispatched.
+// A call is devirtualizable if the method or the class of the object is final, or if the object is not accessed
+// through a pointer or a reference (local variable, member, temporary), so that its dynamic type is known.
+std::vector<VirtualCallSite> findVirtualCalls(GenericAstNode *root, clang::ASTContext &context);
+
+// Virtual table of a dynamic class, as built by the ABI of the target. Empty for other classes.
+std::string describeVTableLayout(clang::CXXRecordDecl const *record, clang::ASTContext &context);
@@ -1,9 +1,16 @@
 #include <QApplication>
 #include <QPushButton>
 #include "MainWindow.h"
+#include "CrossReferences.h"
  
 int main(int argc, char **argv)
 {
+    int exitCode;
+    if (runXRefWorker(argc, argv, exitCode))
+    {
+        return exitCode;
+    }
+
     QApplication app (argc, argv);
     
     MainWindow mainWindow;